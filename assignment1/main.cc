@@ -1,17 +1,31 @@
 #include "parser.h"
+#include "printer.h"
+#include "symbol.h"
 #include <iostream>
 #include <string>
 
-int main() {
+int main(int argc, char *argv[]) {
+  // -m prints with only the parentheses the parser needs
+  bool minimal = argc == 2 && std::string(argv[1]) == "-m";
+  if (argc > 2 || (argc == 2 && !minimal)) {
+    std::cerr << "Usage: " << argv[0] << " <-m>" << std::endl;
+    return 1;
+  }
+
   Parser parser;
+  Printer printer(minimal);
   std::string expression;
 
   while (std::getline(std::cin, expression)) {
+    // Every line starts with an empty symbol table; the tree of the line before is gone by now
+    symbols().clear();
     try {
       auto parsedExpression = parser.parse(expression);
-      std::cout << "Parsed successfully: " << parsedExpression->to_string() << std::endl;
+      std::cout << "Parsed successfully: ";
+      printer.print(parsedExpression.get(), std::cout);
+      std::cout << std::endl;
       // Uncomment the following line to generate a dot file
-      // std::cout << parser.generate_dot(parsedExpression.get()) << std::endl;
+      // parser.generate_dot(parsedExpression.get(), std::cout);
     } catch (const std::runtime_error &e) {
       std::cerr << "Error: " << e.what() << std::endl;
       return 1;
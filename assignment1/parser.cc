@@ -1,16 +1,54 @@
 #include "parser.h"
+#include "printer.h"
 
-VariableNode::VariableNode(const std::string &name) : name(name) {}
+std::string Node::to_string() const {
+  std::string out;
+  Printer().print(this, out);
+  return out;
+}
 
-std::string VariableNode::to_string() const {
-  return name;
+// Deletes the nodes on pending and all their descendants. Every node has its children moved out before
+// it is deleted, so each destructor only runs on a node without children and nothing recurses.
+static void release(std::vector<std::unique_ptr<Node>> &pending) {
+  while (!pending.empty()) {
+    std::unique_ptr<Node> node = std::move(pending.back());
+    pending.pop_back();
+    if (!node) {
+      continue;
+    }
+    if (node->kind == NodeKind::Lambda) {
+      pending.push_back(std::move(static_cast<LambdaNode *>(node.get())->body));
+    } else if (node->kind == NodeKind::Application) {
+      pending.push_back(std::move(static_cast<ApplicationNode *>(node.get())->left));
+      pending.push_back(std::move(static_cast<ApplicationNode *>(node.get())->right));
+    }
+  }
 }
 
-LambdaNode::LambdaNode(const std::string &param, std::unique_ptr<Node> body)
-    : param(param), body(std::move(body)) {}
+VariableNode::VariableNode(Symbol name) : Node(NodeKind::Variable), name(name) {}
+
+LambdaNode::LambdaNode(Symbol param, std::unique_ptr<Node> body)
+    : Node(NodeKind::Lambda), param(param), body(std::move(body)) {}
+
+LambdaNode::~LambdaNode() {
+  if (body) {
+    std::vector<std::unique_ptr<Node>> pending;
+    pending.push_back(std::move(body));
+    release(pending);
+  }
+}
 
 ApplicationNode::ApplicationNode(std::unique_ptr<Node> left, std::unique_ptr<Node> right)
-    : left(std::move(left)), right(std::move(right)) {}
+    : Node(NodeKind::Application), left(std::move(left)), right(std::move(right)) {}
+
+ApplicationNode::~ApplicationNode() {
+  if (left || right) {
+    std::vector<std::unique_ptr<Node>> pending;
+    pending.push_back(std::move(left));
+    pending.push_back(std::move(right));
+    release(pending);
+  }
+}
 
 char Parser::current_char() {
   return pos < input.size() ? input[pos] : '\0';
@@ -22,7 +60,7 @@ void Parser::skip_whitespace() {
   }
 }
 
-std::string Parser::parse_variable() {
+Symbol Parser::parse_variable() {
   // ⟨var⟩ ::= ⟨alphanum⟩ | ⟨var⟩ ⟨alphanum⟩
   skip_whitespace();
   std::string var;
@@ -34,41 +72,63 @@ std::string Parser::parse_variable() {
   while (pos < input.size() && (std::isalpha(input[pos]) || std::isdigit(input[pos]))) {
     var += input[pos++];
   }
-  return var;
+  return symbols().intern(var);
 }
 
 std::unique_ptr<Node> Parser::parse_expression() {
   // ⟨expr⟩ ::= ⟨var⟩ | '(' ⟨expr⟩ ')' | '\' ⟨var⟩ ⟨expr⟩ | ⟨expr⟩ ⟨expr⟩
-  skip_whitespace();
-  auto expr = parse_atom();
+  frames.clear();
+  frames.push_back({Frame::Group, 0, nullptr});
   while (true) {
-    skip_whitespace();
-    if (current_char() == '(' || std::isalpha(current_char())) {
-      auto right = parse_atom();
-      expr = std::make_unique<ApplicationNode>(std::move(expr), std::move(right));
-    } else {
-      break;
+    auto atom = parse_atom();
+    if (!atom) {
+      continue; // Opened a lambda or a bracket, which starts with another atom
+    }
+    while (true) {
+      // The atom is the body of the lambdas waiting for one
+      while (frames.back().kind == Frame::Lambda) {
+        atom = std::make_unique<LambdaNode>(frames.back().param, std::move(atom));
+        frames.pop_back();
+      }
+      Frame &group = frames.back();
+      if (group.expr) {
+        group.expr = std::make_unique<ApplicationNode>(std::move(group.expr), std::move(atom));
+      } else {
+        group.expr = std::move(atom);
+      }
+      skip_whitespace();
+      if (current_char() == '(' || std::isalpha(current_char())) {
+        break;
+      }
+      if (frames.size() == 1) {
+        return std::move(group.expr);
+      }
+      if (current_char() != ')') {
+        throw std::runtime_error("Expected ')'");
+      }
+      pos++;
+      atom = std::move(group.expr);
+      frames.pop_back();
     }
   }
-  return expr;
 }
 
 std::unique_ptr<Node> Parser::parse_atom() {
   // ⟨atom⟩ ::= ⟨var⟩ | '(' ⟨expr⟩ ')' | '\' ⟨var⟩ ⟨expr⟩
+  // Returns a variable, or nothing after opening a lambda or a bracket on the frame stack
   skip_whitespace();
   char ch = current_char();
-  // Pick the right parser based on the current character
+  // Pick the right construct based on the current character
   if (ch == '\\') {
-    return parse_lambda();
-  } else if (ch == '(') {
-    pos++;
-    auto node = parse_expression();
+    pos++; // Skip the '\' character
+    Symbol param = parse_variable(); // Parse the parameter name
     skip_whitespace();
-    if (current_char() != ')') {
-      throw std::runtime_error("Expected ')'");
-    }
+    frames.push_back({Frame::Lambda, param, nullptr}); // The next atom is the body of the lambda
+    return nullptr;
+  } else if (ch == '(') {
     pos++;
-    return node;
+    frames.push_back({Frame::Group, 0, nullptr});
+    return nullptr;
   } else if (std::isalpha(ch)) {
     return std::make_unique<VariableNode>(parse_variable());
   } else {
@@ -76,17 +136,6 @@ std::unique_ptr<Node> Parser::parse_atom() {
   }
 }
 
-std::unique_ptr<Node> Parser::parse_lambda() {
-  // ⟨lambda⟩ ::= '\' ⟨var⟩ ⟨expr⟩
-  pos++; // Skip the '\' character
-  std::string param = parse_variable(); // Parse the parameter name
-  skip_whitespace();
-
-  auto body = parse_atom(); // Parse the body of the lambda
-
-  return std::make_unique<LambdaNode>(param, std::move(body));
-}
-
 std::unique_ptr<Node> Parser::parse(const std::string &input_str) {
   input = input_str;
   pos = 0;
@@ -97,35 +146,63 @@ std::unique_ptr<Node> Parser::parse(const std::string &input_str) {
   return result;
 }
 
-std::string LambdaNode::to_string() const {
-  return "\\" + param + " (" + body->to_string() + ")";
-}
-
-std::string ApplicationNode::to_string() const {
-  return "(" + left->to_string() + " " + right->to_string() + ")";
-}
-
-std::string Parser::generate_dot(const Node* node) {
-  static int counter = 0;
-  std::ostringstream out;
-  if (!node) return "";
-  int cur_id = counter++;
-  std::string label = node->to_string();
-
-  if (auto l = dynamic_cast<const LambdaNode *>(node)) {
-    int body_id = counter;
-    out << generate_dot(l->body.get());
-    out << cur_id << " -> " << body_id << ";\n";
-  } else if (auto a = dynamic_cast<const ApplicationNode *>(node)) {
-    int left_id = counter;
-    out << generate_dot(a->left.get());
-    out << cur_id << " -> " << left_id << ";\n";
-
-    int right_id = counter;
-    out << generate_dot(a->right.get());
-    out << cur_id << " -> " << right_id << ";\n";
+// Text of a graph collected before it is written to the stream
+static const size_t DOT_CHUNK_SIZE = 1 << 16;
+
+void Parser::generate_dot(const Node *node, std::ostream &out) {
+  // A node still to visit and the id of its parent, or with label set, a visited node whose label is next
+  struct Step {
+    const Node *node;
+    int id;
+    bool label;
+  };
+  std::vector<Step> steps;
+  // Text collected before it is written to out
+  std::string text;
+  // Numbered per graph from 0
+  int ids = 0;
+  steps.push_back({node, -1, false});
+  while (!steps.empty()) {
+    if (text.size() >= DOT_CHUNK_SIZE) {
+      out.write(text.data(), static_cast<std::streamsize>(text.size()));
+      text.clear();
+    }
+    Step step = steps.back();
+    steps.pop_back();
+    if (step.label) {
+      text += std::to_string(step.id);
+      text += " [label=\"";
+      switch (step.node->kind) {
+        case NodeKind::Variable:
+          text += "Variable: ";
+          text += symbols().name(static_cast<const VariableNode *>(step.node)->name);
+          break;
+        case NodeKind::Lambda:
+          text += "Lambda: ";
+          text += symbols().name(static_cast<const LambdaNode *>(step.node)->param);
+          break;
+        case NodeKind::Application:
+          text += "Application";
+          break;
+      }
+      text += "\"];\n";
+      continue;
+    }
+    int id = ids++;
+    if (step.id != -1) {
+      text += std::to_string(step.id);
+      text += " -> ";
+      text += std::to_string(id);
+      text += ";\n";
+    }
+    steps.push_back({step.node, id, true});
+    if (step.node->kind == NodeKind::Lambda) {
+      steps.push_back({static_cast<const LambdaNode *>(step.node)->body.get(), id, false});
+    } else if (step.node->kind == NodeKind::Application) {
+      auto a = static_cast<const ApplicationNode *>(step.node);
+      steps.push_back({a->right.get(), id, false});
+      steps.push_back({a->left.get(), id, false});
+    }
   }
-
-  out << cur_id << " [label=\"" << label << "\"];\n";
-  return out.str();
+  out.write(text.data(), static_cast<std::streamsize>(text.size()));
 }
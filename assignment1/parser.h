@@ -6,31 +6,43 @@
 #include <memory>
 #include <cctype>
 #include <sstream>
+#include <cstdint>
+#include <vector>
+#include "symbol.h"
+
+// Tag of the concrete node class. Traversals switch on it instead of using dynamic_cast.
+enum class NodeKind : uint8_t {
+  Variable, Lambda, Application
+};
 
 class Node {
 public:
+  const NodeKind kind;
+
+  explicit Node(NodeKind kind) : kind(kind) {}
+
   virtual ~Node() = default;
 
-  virtual std::string to_string() const = 0;
+  // Text in the default format of Printer, which prints without recursing
+  std::string to_string() const;
 };
 
 class VariableNode : public Node {
 public:
-  std::string name;
+  Symbol name;
 
-  VariableNode(const std::string &name);
-
-  std::string to_string() const override;
+  VariableNode(Symbol name);
 };
 
 class LambdaNode : public Node {
 public:
-  std::string param;
+  Symbol param;
   std::unique_ptr<Node> body;
 
-  LambdaNode(const std::string &param, std::unique_ptr<Node> body);
+  LambdaNode(Symbol param, std::unique_ptr<Node> body);
 
-  std::string to_string() const override;
+  // Releases the subtree iteratively instead of through the recursive unique_ptr destructors
+  ~LambdaNode() override;
 };
 
 class ApplicationNode : public Node {
@@ -40,31 +52,44 @@ public:
 
   ApplicationNode(std::unique_ptr<Node> left, std::unique_ptr<Node> right);
 
-  std::string to_string() const override;
+  ~ApplicationNode() override;
 };
 
 class Parser {
 public:
   std::unique_ptr<Node> parse(const std::string &input_str);
 
-  std::string generate_dot(const Node* node);
+  // Writes the nodes and edges of the tree of node to out, in one pass with an explicit stack. Ids are
+  // numbered per call from 0.
+  void generate_dot(const Node *node, std::ostream &out);
 
 private:
+  // Construct that is still open while parsing: the top level or a bracketed expression (Group), or a
+  // lambda waiting for its body. They are kept on a heap stack instead of recursing per nesting level.
+  struct Frame {
+    enum Kind : uint8_t {
+      Group, Lambda
+    };
+
+    Kind kind;
+    Symbol param;              // Lambda: the parameter
+    std::unique_ptr<Node> expr; // Group: the applications parsed so far, empty before the first atom
+  };
+
   std::string input;
   size_t pos = 0;
+  std::vector<Frame> frames;
 
   char current_char();
 
   void skip_whitespace();
 
-  std::string parse_variable();
+  Symbol parse_variable();
 
   std::unique_ptr<Node> parse_expression();
 
   std::unique_ptr<Node> parse_atom();
 
-  std::unique_ptr<Node> parse_lambda();
-
 };
 
 
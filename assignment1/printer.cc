@@ -0,0 +1,69 @@
+// printer.cc
+#include "printer.h"
+
+// Text collected before it is written to a stream
+static const size_t CHUNK_SIZE = 1 << 16;
+
+void Printer::print(const Node *node, std::string &out) {
+  write(node, out, nullptr);
+}
+
+void Printer::print(const Node *node, std::ostream &stream) {
+  buffer.clear();
+  write(node, buffer, &stream);
+  stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+}
+
+void Printer::write(const Node *node, std::string &out, std::ostream *stream) {
+  // Pieces still to print, the next one last
+  pending.clear();
+  pending.push_back({node, nullptr, Piece::Function});
+  while (!pending.empty()) {
+    if (stream && out.size() >= CHUNK_SIZE) {
+      stream->write(out.data(), static_cast<std::streamsize>(out.size()));
+      out.clear();
+    }
+    Piece piece = pending.back();
+    pending.pop_back();
+    if (!piece.node) {
+      out += piece.text;
+      continue;
+    }
+    switch (piece.node->kind) {
+      case NodeKind::Variable:
+        out += symbols().name(static_cast<const VariableNode *>(piece.node)->name);
+        break;
+      case NodeKind::Lambda: {
+        auto l = static_cast<const LambdaNode *>(piece.node);
+        // The parser only starts an argument at a variable or a bracket
+        bool brackets = minimal && piece.place == Piece::Argument;
+        if (brackets) {
+          out += "(";
+          pending.push_back({nullptr, ")", Piece::Function});
+        }
+        out += "\\";
+        out += symbols().name(l->param);
+        if (minimal) {
+          out += " ";
+        } else {
+          out += " (";
+          pending.push_back({nullptr, ")", Piece::Function});
+        }
+        pending.push_back({l->body.get(), nullptr, Piece::Body});
+        break;
+      }
+      case NodeKind::Application: {
+        auto a = static_cast<const ApplicationNode *>(piece.node);
+        bool brackets = !minimal || piece.place != Piece::Function;
+        if (brackets) {
+          out += "(";
+          pending.push_back({nullptr, ")", Piece::Function});
+        }
+        pending.push_back({a->right.get(), nullptr, Piece::Argument});
+        pending.push_back({nullptr, " ", Piece::Function});
+        pending.push_back({a->left.get(), nullptr, Piece::Function});
+        break;
+      }
+    }
+  }
+}
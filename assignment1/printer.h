@@ -0,0 +1,45 @@
+// printer.h
+#ifndef PRINTER_H
+#define PRINTER_H
+
+#include "parser.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Writes terms as text in one pass, with an explicit stack instead of recursion, so the time is linear in
+// the length of the text and no intermediate strings are built. The default format puts every application
+// and every lambda body in parentheses: \x ((f x)). The minimal format only brackets what the parser needs:
+// an application that is an argument or the body of a lambda, and a lambda that is an argument, since a
+// lambda takes a single atom as its body and applications associate to the left: \x (f x) y (\z z).
+class Printer {
+public:
+  explicit Printer(bool minimal = false) : minimal(minimal) {}
+
+  // Appends the text of node to out
+  void print(const Node *node, std::string &out);
+
+  // Writes the text of node to stream in chunks, so a large term is never held as one string
+  void print(const Node *node, std::ostream &stream);
+
+private:
+  // Node still to print, or a literal when node is null, and where the node is in its parent
+  struct Piece {
+    enum Place : uint8_t {
+      Function, Argument, Body
+    };
+
+    const Node *node;
+    const char *text;
+    Place place;
+  };
+
+  bool minimal;
+  // Kept between calls so their capacity is reused
+  std::vector<Piece> pending;
+  std::string buffer;
+
+  void write(const Node *node, std::string &out, std::ostream *stream);
+};
+
+#endif //PRINTER_H
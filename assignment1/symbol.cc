@@ -0,0 +1,31 @@
+// symbol.cc
+#include "symbol.h"
+
+Symbol SymbolTable::intern(const std::string &name) {
+  auto found = ids.find(name);
+  if (found != ids.end()) {
+    return found->second;
+  }
+  Symbol symbol = static_cast<Symbol>(names.size());
+  names.push_back(name);
+  ids.emplace(name, symbol);
+  return symbol;
+}
+
+const std::string &SymbolTable::name(Symbol symbol) const {
+  return names[symbol];
+}
+
+void SymbolTable::clear() {
+  ids.clear();
+  names.clear();
+}
+
+size_t SymbolTable::size() const {
+  return names.size();
+}
+
+SymbolTable &symbols() {
+  static SymbolTable table;
+  return table;
+}
@@ -0,0 +1,32 @@
+// symbol.h
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+typedef uint32_t Symbol;
+
+// Global symbol table: identifiers are interned once at parse time and afterwards handled as compact
+// integer ids, so comparing or hashing a name never touches the string again.
+class SymbolTable {
+public:
+  Symbol intern(const std::string &name);
+
+  const std::string &name(Symbol symbol) const;
+
+  // Forgets all symbols, so the table does not grow with the lines before
+  void clear();
+
+  size_t size() const;
+
+private:
+  std::unordered_map<std::string, Symbol> ids;
+  std::deque<std::string> names; // A deque keeps references returned by name() valid while interning
+};
+
+SymbolTable &symbols();
+
+#endif //SYMBOL_H
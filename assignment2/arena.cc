@@ -0,0 +1,55 @@
+// arena.cc
+#include "arena.h"
+#include <cstdint>
+
+Arena::~Arena() {
+  reset();
+  for (auto &block: blocks) {
+    ::operator delete(block.data);
+  }
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+  auto addr = reinterpret_cast<uintptr_t>(ptr);
+  uintptr_t aligned = (addr + align - 1) & ~(uintptr_t(align) - 1);
+  if (!ptr || aligned + size > reinterpret_cast<uintptr_t>(end)) {
+    next_block(size + align);
+    addr = reinterpret_cast<uintptr_t>(ptr);
+    aligned = (addr + align - 1) & ~(uintptr_t(align) - 1);
+  }
+  char *result = reinterpret_cast<char *>(aligned);
+  used += (result + size) - ptr;
+  ptr = result + size;
+  return result;
+}
+
+void Arena::next_block(size_t min_size) {
+  // Reuse a block kept from an earlier line if one is large enough
+  size_t next = ptr ? current + 1 : 0;
+  while (next < blocks.size() && blocks[next].size < min_size) {
+    ++next;
+  }
+  if (next == blocks.size()) {
+    size_t size = min_size > BLOCK_SIZE ? min_size : BLOCK_SIZE;
+    blocks.push_back({static_cast<char *>(::operator new(size)), size});
+  }
+  current = next;
+  ptr = blocks[current].data;
+  end = ptr + blocks[current].size;
+}
+
+void Arena::reset() {
+  // Destroy in reverse order of construction, without walking any tree
+  for (auto it = finalizers.rbegin(); it != finalizers.rend(); ++it) {
+    it->run(it->obj);
+  }
+  finalizers.clear();
+  current = 0;
+  ptr = nullptr;
+  end = nullptr;
+  used = 0;
+}
+
+size_t Arena::bytes_used() const {
+  return used;
+}
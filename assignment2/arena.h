@@ -0,0 +1,67 @@
+// arena.h
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for the AST. The parser and the interpreter allocate every node of an input line
+// from the same arena, and reset() frees all of them at once instead of deleting tree by tree.
+class Arena {
+public:
+  Arena() = default;
+
+  Arena(const Arena &) = delete;
+
+  Arena &operator=(const Arena &) = delete;
+
+  ~Arena();
+
+  void *allocate(size_t size, size_t align);
+
+  template<typename T, typename... Args>
+  T *make(Args &&... args) {
+    T *obj = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    // Only objects that own resources need their destructor run on reset
+    if (!std::is_trivially_destructible<T>::value) {
+      finalizers.push_back({obj, &destroy<T>});
+    }
+    return obj;
+  }
+
+  void reset();
+
+  size_t bytes_used() const;
+
+private:
+  struct Block {
+    char *data;
+    size_t size;
+  };
+
+  struct Finalizer {
+    void *obj;
+    void (*run)(void *);
+  };
+
+  template<typename T>
+  static void destroy(void *obj) {
+    static_cast<T *>(obj)->~T();
+  }
+
+  static const size_t BLOCK_SIZE = 64 * 1024;
+
+  std::vector<Block> blocks;
+  size_t current = 0; // Index of the block that is being bumped
+  char *ptr = nullptr;
+  char *end = nullptr;
+  size_t used = 0;
+  std::vector<Finalizer> finalizers;
+
+  void next_block(size_t min_size);
+};
+
+#endif //ARENA_H
@@ -0,0 +1,19 @@
+# bench.awk: prints n lines of Church arithmetic for the bench target of the Makefile. Every line multiplies
+# two numerals of up to size and applies the product to the identity and a free variable, so call-by-value
+# reduces it completely to that variable and the time goes into reduction rather than printing.
+# Usage: awk -v n=200 -v size=40 -f bench.awk
+function numeral(k,   s, i) {
+  s = "(\\f (\\x "
+  for (i = 0; i < k; i++) s = s "(f "
+  s = s "x"
+  for (i = 0; i < k; i++) s = s ")"
+  return s "))"
+}
+BEGIN {
+  mult = "(\\m (\\n (\\f (\\x ((m (n f)) x)))))"
+  for (line = 0; line < n; line++) {
+    a = line % size + 1
+    b = (line * 7) % size + 1
+    printf "((((%s %s) %s) (\\y y)) z)\n", mult, numeral(a), numeral(b)
+  }
+}
@@ -0,0 +1,275 @@
+// cek.cc
+#include "cek.h"
+#include "interpreter.h"
+
+Node *CekMachine::eval(Node *node, int &iterations) {
+  // The values and terms of the previous expression are no longer needed
+  reset_values();
+  terms.reset();
+  quoted.clear();
+  std::vector<Symbol> binders;
+  CekValue *value = run(terms.from_node(node, binders), iterations);
+  return terms.to_node(readback(value));
+}
+
+void CekMachine::reset_values() {
+  arena.reset();
+  free_values = nullptr;
+  free_envs = nullptr;
+}
+
+CekValue *CekMachine::make_value(CekValue::Kind kind) {
+  CekValue fresh = {kind, 1, NO_SYMBOL, 0, nullptr, nullptr, nullptr, nullptr, 0};
+  if (!free_values) {
+    return arena.make<CekValue>(fresh);
+  }
+  CekValue *value = free_values;
+  free_values = value->fn;
+  *value = fresh;
+  return value;
+}
+
+CekEnv *CekMachine::make_env(CekValue *value, CekEnv *next) {
+  CekEnv fresh = {value, next, hash_combine(value->hash, env_hash(next)), 1};
+  if (!free_envs) {
+    return arena.make<CekEnv>(fresh);
+  }
+  CekEnv *env = free_envs;
+  free_envs = env->next;
+  *env = fresh;
+  return env;
+}
+
+void CekMachine::collect() {
+  while (!dead_values.empty() || !dead_envs.empty()) {
+    if (!dead_envs.empty()) {
+      CekEnv *env = dead_envs.back();
+      dead_envs.pop_back();
+      if (--env->value->refs == 0) {
+        dead_values.push_back(env->value);
+      }
+      if (env->next && --env->next->refs == 0) {
+        dead_envs.push_back(env->next);
+      }
+      env->next = free_envs;
+      free_envs = env;
+      continue;
+    }
+    CekValue *value = dead_values.back();
+    dead_values.pop_back();
+    if (value->kind == CekValue::Closure) {
+      if (value->env && --value->env->refs == 0) {
+        dead_envs.push_back(value->env);
+      }
+    } else if (value->kind == CekValue::Stuck) {
+      if (--value->fn->refs == 0) {
+        dead_values.push_back(value->fn);
+      }
+      if (--value->arg->refs == 0) {
+        dead_values.push_back(value->arg);
+      }
+    }
+    value->fn = free_values;
+    free_values = value;
+  }
+}
+
+bool CekMachine::equal(const CekEnv *a, const CekEnv *b) {
+  // Pairs of values still to compare; environments are compared by pushing their entries
+  std::vector<std::pair<const CekValue *, const CekValue *>> pending;
+  std::vector<std::pair<const CekEnv *, const CekEnv *>> envs = {{a, b}};
+  while (!envs.empty() || !pending.empty()) {
+    if (!envs.empty()) {
+      const CekEnv *x = envs.back().first;
+      const CekEnv *y = envs.back().second;
+      envs.pop_back();
+      for (; x != y; x = x->next, y = y->next) {
+        if (!x || !y || x->hash != y->hash) {
+          return false;
+        }
+        pending.push_back({x->value, y->value});
+      }
+      continue;
+    }
+    const CekValue *x = pending.back().first;
+    const CekValue *y = pending.back().second;
+    pending.pop_back();
+    if (x == y) {
+      continue;
+    }
+    if (x->kind != y->kind || x->hash != y->hash) {
+      return false;
+    }
+    if (x->kind == CekValue::Free) {
+      if (x->name != y->name) {
+        return false;
+      }
+    } else if (x->kind == CekValue::Closure) {
+      if (x->lambda != y->lambda) {
+        return false;
+      }
+      envs.push_back({x->env, y->env});
+    } else {
+      pending.push_back({x->fn, y->fn});
+      pending.push_back({x->arg, y->arg});
+    }
+  }
+  return true;
+}
+
+CekValue *CekMachine::run(DBTerm *control, int &iterations) {
+  // env, value and every frame and call started own a reference to what they point to
+  CekEnv *env = nullptr;
+  CekValue *value = nullptr;
+  stack.clear();
+  started.clear();
+  active.clear();
+
+  while (true) {
+    if (control) {
+      // Evaluate the control term in env
+      if (iterations >= max_iterations) {
+        throw std::runtime_error("Maximum number of iterations reached");
+      }
+      iterations++;
+
+      if (control->kind == DBTerm::Bound) {
+        CekEnv *entry = env;
+        for (uint32_t i = 0; i < control->value; ++i) {
+          entry = entry->next;
+        }
+        value = retain(entry->value);
+        release(env);
+        env = nullptr;
+        control = nullptr;
+      } else if (control->kind == DBTerm::Free) {
+        value = make_value(CekValue::Free);
+        value->name = control->value;
+        value->hash = hash_combine(CekValue::Free, control->value);
+        release(env);
+        env = nullptr;
+        control = nullptr;
+      } else if (control->kind == DBTerm::Lambda) {
+        value = make_value(CekValue::Closure);
+        value->lambda = control;
+        value->env = env;
+        value->hash = hash_combine(hash_combine(CekValue::Closure, control->hash), env_hash(env));
+        env = nullptr;
+        control = nullptr;
+      } else {
+        // Function first, the argument is remembered on the stack
+        stack.push_back({Frame::Argument, control->right, retain(env), nullptr});
+        control = control->left;
+      }
+    } else {
+      // Pass value to the innermost continuation
+      if (stack.empty()) {
+        return value;
+      }
+      // The value is passed to the top frame, so every call started above it is done
+      while (!started.empty() && started.back().depth >= stack.size()) {
+        active.erase(started.back());
+        release(started.back().env);
+        started.pop_back();
+      }
+      Frame frame = stack.back();
+      stack.pop_back();
+
+      if (frame.kind == Frame::Argument) {
+        stack.push_back({Frame::Apply, nullptr, nullptr, value});
+        control = frame.term;
+        env = frame.env;
+      } else if (frame.fn->kind == CekValue::Closure) {
+        // Beta step: bind the argument instead of substituting it. The argument is shared, not copied.
+        env = make_env(value, retain(frame.fn->env));
+        control = frame.fn->lambda->left;
+        release(frame.fn);
+        // The machine is deterministic, so reaching the same body and environment again within the call
+        // proves it never returns
+        Start start = {control, env, stack.size()};
+        if (!active.insert(start).second) {
+          throw DivergenceError("Expression does not terminate: the reduction returned to an earlier state");
+        }
+        started.push_back(start);
+        retain(env);
+      } else {
+        CekValue *stuck = make_value(CekValue::Stuck);
+        stuck->fn = frame.fn;
+        stuck->arg = value;
+        stuck->hash = hash_combine(hash_combine(CekValue::Stuck, frame.fn->hash), value->hash);
+        value = stuck;
+      }
+    }
+  }
+}
+
+DBTerm *CekMachine::readback(CekValue *value) {
+  // Runs on the task stack, so neither deep values nor deep terms can overflow the native stack
+  tasks.clear();
+  built.clear();
+  tasks.push_back({Task::Value, value, nullptr, nullptr, 0});
+  while (!tasks.empty()) {
+    Task task = tasks.back();
+    tasks.pop_back();
+    switch (task.kind) {
+      case Task::Value: {
+        // A value reads back to a closed term, so it can be shared by every place it occurs
+        auto found = quoted.find(task.value);
+        if (found != quoted.end()) {
+          built.push_back(found->second);
+        } else if (task.value->kind == CekValue::Free) {
+          DBTerm *term = terms.make(DBTerm::Free, task.value->name, nullptr, nullptr);
+          quoted[task.value] = term;
+          built.push_back(term);
+        } else if (task.value->kind == CekValue::Stuck) {
+          tasks.push_back({Task::Stuck, task.value, nullptr, nullptr, 0});
+          tasks.push_back({Task::Value, task.value->arg, nullptr, nullptr, 0});
+          tasks.push_back({Task::Value, task.value->fn, nullptr, nullptr, 0});
+        } else {
+          tasks.push_back({Task::Closure, task.value, nullptr, nullptr, 0});
+          tasks.push_back({Task::Term, nullptr, task.value->lambda->left, task.value->env, 1});
+        }
+        break;
+      }
+      case Task::Term: {
+        // Indices below depth are bound inside the term, the others are looked up in env
+        DBTerm *term = task.term;
+        if (term->loose <= task.depth) {
+          built.push_back(term);
+        } else if (term->kind == DBTerm::Bound) {
+          CekEnv *entry = task.env;
+          for (uint32_t i = task.depth; i < term->value; ++i) {
+            entry = entry->next;
+          }
+          tasks.push_back({Task::Value, entry->value, nullptr, nullptr, 0});
+        } else if (term->kind == DBTerm::Lambda) {
+          tasks.push_back({Task::Lambda, nullptr, term, nullptr, 0});
+          tasks.push_back({Task::Term, nullptr, term->left, task.env, task.depth + 1});
+        } else {
+          tasks.push_back({Task::Application, nullptr, nullptr, nullptr, 0});
+          tasks.push_back({Task::Term, nullptr, term->right, task.env, task.depth});
+          tasks.push_back({Task::Term, nullptr, term->left, task.env, task.depth});
+        }
+        break;
+      }
+      case Task::Closure:
+        built.back() = terms.make(DBTerm::Lambda, task.value->lambda->value, built.back(), nullptr);
+        quoted[task.value] = built.back();
+        break;
+      case Task::Lambda:
+        built.back() = terms.make(DBTerm::Lambda, task.term->value, built.back(), nullptr);
+        break;
+      case Task::Stuck:
+      case Task::Application: {
+        DBTerm *right = built.back();
+        built.pop_back();
+        built.back() = terms.make(DBTerm::Application, 0, built.back(), right);
+        if (task.kind == Task::Stuck) {
+          quoted[task.value] = built.back();
+        }
+        break;
+      }
+    }
+  }
+  return built.back();
+}
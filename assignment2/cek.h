@@ -0,0 +1,168 @@
+// cek.h
+#ifndef CEK_H
+#define CEK_H
+
+#include "parser.h"
+#include "pool.h"
+#include "arena.h"
+#include "debruijn.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct CekEnv;
+
+// Result of evaluating a term: a lambda together with the environment it was created in, or a
+// stuck term whose head is a free variable. Values and environments are shared by counting the references
+// to them, so binding a value in several environments only increments its count.
+struct CekValue {
+  enum Kind : uint8_t {
+    Closure, Free, Stuck
+  };
+
+  Kind kind;
+  uint32_t refs;   // Environments, values, frames and registers of the machine that refer to the value
+  Symbol name;     // Free: the variable
+  uint32_t entry;  // Closure made by BytecodeMachine: the address of the body code
+  DBTerm *lambda;  // Closure: the lambda term
+  CekEnv *env;     // Closure: values of the variables the lambda refers to
+  CekValue *fn;    // Stuck: the function part
+  CekValue *arg;   // Stuck: the argument
+  size_t hash;     // Structural hash, the same for equal values
+};
+
+// Environment as a linked list, where de Bruijn index i is the i-th entry
+struct CekEnv {
+  CekValue *value;
+  CekEnv *next;
+  size_t hash;   // Structural hash of the entries
+  uint32_t refs; // Environments, closures, frames and registers of the machine that refer to the entry
+};
+
+// Call-by-value CEK machine. Instead of substituting, a beta step pushes the argument onto the environment
+// of the closure, so it takes constant time and never rebuilds the body. Reduces in the same order as
+// Interpreter::eval; the readback phase substitutes the environments back into the result.
+class CekMachine {
+public:
+  // cap is passed on to the conversion of the result, see DeBruijnEngine
+  CekMachine(NodePool &pool, int max_iterations = MAX_ITERATIONS, size_t cap = 0)
+      : terms(pool, MAX_ITERATIONS, nullptr, cap), max_iterations(max_iterations) {}
+
+  Node *eval(Node *node, int &iterations);
+
+protected:
+  // BytecodeMachine runs compiled code on the same values, environments and readback
+  struct Frame {
+    enum Kind : uint8_t {
+      Argument, // Evaluate the argument term next
+      Apply     // Apply the function value to the value just computed
+    };
+
+    Kind kind;
+    DBTerm *term;
+    CekEnv *env;
+    CekValue *fn;
+  };
+
+  // Control and environment of the body after a beta step, which continues the call that reduced the
+  // application at stack depth
+  struct Start {
+    DBTerm *control;
+    CekEnv *env;
+    size_t depth;
+  };
+
+  struct StartHash {
+    size_t operator()(const Start &start) const { return hash_combine(start.control->hash, env_hash(start.env)); }
+  };
+
+  struct StartEqual {
+    bool operator()(const Start &a, const Start &b) const {
+      return a.control == b.control && equal(a.env, b.env);
+    }
+  };
+
+  // Pending step of the readback: quote a value or a term under env, or build a term from the results
+  // of the steps before it
+  struct Task {
+    enum Kind : uint8_t {
+      Value, Term, Closure, Stuck, Lambda, Application
+    };
+
+    Kind kind;
+    CekValue *value; // Value, Closure, Stuck
+    DBTerm *term;    // Term, Lambda
+    CekEnv *env;     // Term
+    uint32_t depth;  // Term: number of lambdas of the term entered so far
+  };
+
+  DeBruijnEngine terms; // Converts between nodes and de Bruijn terms
+  int max_iterations;
+  Arena arena;          // Holds the values and environments of the expression being evaluated
+  // Released values and environments, reused before the arena grows. A value is linked through fn and an
+  // environment through next.
+  CekValue *free_values = nullptr;
+  CekEnv *free_envs = nullptr;
+  // Values and environments whose count dropped to zero, whose references are still to be released
+  std::vector<CekValue *> dead_values;
+  std::vector<CekEnv *> dead_envs;
+  std::vector<Frame> stack;
+  // Beta steps of the calls in progress, in the order they were started
+  std::vector<Start> started;
+  std::unordered_set<Start, StartHash, StartEqual> active;
+  std::vector<Task> tasks;
+  std::vector<DBTerm *> built;
+  std::unordered_map<CekValue *, DBTerm *> quoted;
+
+  // Forgets all values and environments of the previous expression
+  void reset_values();
+
+  // Returns a value with a count of 1, owned by the caller
+  CekValue *make_value(CekValue::Kind kind);
+
+  // Returns an environment with a count of 1 that takes over the references to value and next
+  CekEnv *make_env(CekValue *value, CekEnv *next);
+
+  static CekValue *retain(CekValue *value) {
+    ++value->refs;
+    return value;
+  }
+
+  static CekEnv *retain(CekEnv *env) {
+    if (env) {
+      ++env->refs;
+    }
+    return env;
+  }
+
+  // Drops a reference. A value or environment that is no longer referred to is put on its free list at
+  // once, and so is everything only it referred to.
+  void release(CekValue *value) {
+    if (--value->refs == 0) {
+      dead_values.push_back(value);
+      collect();
+    }
+  }
+
+  void release(CekEnv *env) {
+    if (env && --env->refs == 0) {
+      dead_envs.push_back(env);
+      collect();
+    }
+  }
+
+  // Frees the dead values and environments with an explicit stack, so a long chain cannot overflow the
+  // native stack
+  void collect();
+
+  static size_t env_hash(const CekEnv *env) { return env ? env->hash : 0; }
+
+  // Compares two environments entry by entry, and the values in them by structure
+  static bool equal(const CekEnv *a, const CekEnv *b);
+
+  CekValue *run(DBTerm *control, int &iterations);
+
+  DBTerm *readback(CekValue *value);
+};
+
+#endif //CEK_H
@@ -0,0 +1,274 @@
+// church.cc
+#include "church.h"
+#include "interpreter.h"
+
+// Most arguments any combinator takes
+static const uint32_t MAX_ARITY = 2;
+
+ChurchArithmetic::ChurchArithmetic() {
+  // The usual definitions, in the variants that are common enough to be worth a template
+  add("\\n \\f \\x (f ((n f) x))", Op::Succ, 1, Type::Number, Type::Number);
+  add("\\n \\f \\x ((n f) (f x))", Op::Succ, 1, Type::Number, Type::Number);
+  add("\\n \\f \\x (((n (\\g \\h (h (g f)))) (\\u x)) (\\u u))", Op::Pred, 1, Type::Number, Type::Number);
+  add("\\m \\n \\f \\x ((m f) ((n f) x))", Op::Plus, 2, Type::Number, Type::Number);
+  add("\\m \\n ((m (\\n \\f \\x (f ((n f) x)))) n)", Op::Plus, 2, Type::Number, Type::Number);
+  add("\\m \\n \\f (m (n f))", Op::Mult, 2, Type::Number, Type::Number);
+  add("\\m \\n \\f \\x ((m (n f)) x)", Op::Mult, 2, Type::Number, Type::Number);
+  add("\\m \\n (n m)", Op::Exp, 2, Type::Number, Type::Number);
+  add("\\n ((n (\\x \\a \\b b)) (\\a \\b a))", Op::IsZero, 1, Type::Number, Type::Boolean);
+  add("\\p \\q ((p q) p)", Op::And, 2, Type::Boolean, Type::Boolean);
+  add("\\p \\q ((p q) (\\a \\b b))", Op::And, 2, Type::Boolean, Type::Boolean);
+  add("\\p \\q ((p p) q)", Op::Or, 2, Type::Boolean, Type::Boolean);
+  add("\\p \\q ((p (\\a \\b a)) q)", Op::Or, 2, Type::Boolean, Type::Boolean);
+  add("\\p ((p (\\a \\b b)) (\\a \\b a))", Op::Not, 1, Type::Boolean, Type::Boolean);
+  add("\\p \\a \\b ((p b) a)", Op::Not, 1, Type::Boolean, Type::Boolean);
+}
+
+void ChurchArithmetic::add(const char *text, Op op, uint32_t arity, Type argument, Type result) {
+  Parser parser(templates);
+  combinators.push_back({parser.parse(text), op, arity, argument, result});
+}
+
+void ChurchArithmetic::reset() {
+  numbers.clear();
+  suffix = 0;
+}
+
+Symbol ChurchArithmetic::unused(const std::string &base) {
+  // Every name of the expression is interned, so a name that interning adds occurs nowhere in it. The suffixes
+  // are letters (a, ..., z, aa, ab, ...), while SymbolTable::fresh appends digits, so alpha-conversion cannot
+  // pick the name later either.
+  while (true) {
+    std::string name = base;
+    size_t end = name.size();
+    for (unsigned i = suffix; i > 0; i = (i - 1) / 26) {
+      name.insert(end, 1, static_cast<char>('a' + (i - 1) % 26));
+    }
+    size_t count = symbols().size();
+    Symbol symbol = symbols().intern(name);
+    if (symbols().size() > count) {
+      return symbol;
+    }
+    ++suffix;
+  }
+}
+
+const ChurchArithmetic::Combinator *ChurchArithmetic::match(Node *node) const {
+  if (node->kind != NodeKind::Lambda) {
+    return nullptr;
+  }
+  // The shape leaves out the names, so it rules out almost every lambda before the full comparison
+  for (const Combinator &combinator: combinators) {
+    if (combinator.term->shape == node->shape && InterpreterBase::alpha_equivalent(combinator.term, node)) {
+      return &combinator;
+    }
+  }
+  return nullptr;
+}
+
+Node *ChurchArithmetic::reduce(Node *node, NodePool &pool) {
+  // The interpreter enters the applications of a spine from the outside in, so only an application whose
+  // function is a combinator with exactly its arguments is taken; extra arguments are applied to the result.
+  Node *head = node;
+  for (uint32_t count = 1; count <= MAX_ARITY && head->kind == NodeKind::Application; ++count) {
+    head = static_cast<ApplicationNode *>(head)->left;
+    const Combinator *combinator = match(head);
+    if (combinator) {
+      uint64_t value;
+      if (combinator->arity != count || !evaluate(node, combinator->result, value)) {
+        return nullptr;
+      }
+      return encode(value, combinator->result, pool);
+    }
+  }
+  return nullptr;
+}
+
+bool ChurchArithmetic::evaluate(Node *node, Type type, uint64_t &value) {
+  // Post-order on an explicit stack: the values of the arguments of a combinator are on top of values, the
+  // first one deepest, when its task comes up
+  tasks.clear();
+  values.clear();
+  tasks.push_back({node, type, nullptr});
+  while (!tasks.empty()) {
+    Task task = tasks.back();
+    tasks.pop_back();
+    if (task.op) {
+      size_t base = values.size() - task.op->arity;
+      uint64_t result;
+      if (!apply(task.op->op, values.data() + base, result)) {
+        return false;
+      }
+      values.resize(base);
+      values.push_back(result);
+      continue;
+    }
+    uint64_t decoded;
+    if (decode(task.node, task.type, decoded)) {
+      values.push_back(decoded);
+      continue;
+    }
+    // Anything else must be a combinator applied to exactly its arguments, last argument first in args
+    args.clear();
+    Node *head = task.node;
+    while (head->kind == NodeKind::Application && args.size() < MAX_ARITY) {
+      args.push_back(static_cast<ApplicationNode *>(head)->right);
+      head = static_cast<ApplicationNode *>(head)->left;
+    }
+    const Combinator *combinator = match(head);
+    if (!combinator || combinator->arity != args.size() || combinator->result != task.type) {
+      return false;
+    }
+    tasks.push_back({nullptr, task.type, combinator});
+    for (Node *arg: args) {
+      tasks.push_back({arg, combinator->argument, nullptr});
+    }
+  }
+  value = values.back();
+  return true;
+}
+
+bool ChurchArithmetic::decode(Node *node, Type type, uint64_t &value) {
+  // \f \x f (f ... (f x)) is the number of f, \a \b a is true and \a \b b is false
+  if (node->kind != NodeKind::Lambda) {
+    return false;
+  }
+  if (type == Type::Number) {
+    auto found = numbers.find(node);
+    if (found != numbers.end()) {
+      value = found->second;
+      return true;
+    }
+  }
+  auto outer = static_cast<LambdaNode *>(node);
+  if (outer->body->kind != NodeKind::Lambda) {
+    return false;
+  }
+  auto inner = static_cast<LambdaNode *>(outer->body);
+  Node *body = inner->body;
+  // A boolean is a bare variable, and \f \x (f x) is the number 1 rather than true
+  if (type == Type::Boolean && body->kind != NodeKind::Variable) {
+    return false;
+  }
+  uint64_t count = 0;
+  // When both parameters have one name, the inner one hides the outer one and only 0 and false are left
+  while (outer->param != inner->param && body->kind == NodeKind::Application) {
+    auto a = static_cast<ApplicationNode *>(body);
+    if (a->left->kind != NodeKind::Variable || static_cast<VariableNode *>(a->left)->name != outer->param) {
+      return false;
+    }
+    ++count;
+    body = a->right;
+  }
+  if (body->kind != NodeKind::Variable) {
+    return false;
+  }
+  Symbol name = static_cast<VariableNode *>(body)->name;
+  if (type == Type::Boolean) {
+    if (name == inner->param) {
+      value = 0;
+    } else if (name == outer->param) {
+      value = 1;
+    } else {
+      return false;
+    }
+    return true;
+  }
+  if (name != inner->param) {
+    return false;
+  }
+  numbers.emplace(node, count);
+  value = count;
+  return true;
+}
+
+Node *ChurchArithmetic::encode(uint64_t value, Type type, NodePool &pool) {
+  if (type == Type::Boolean) {
+    Symbol x = unused("x");
+    Symbol y = unused("y");
+    return pool.lambda(x, pool.lambda(y, pool.variable(value ? x : y)));
+  }
+  if (value > MAX_NUMERAL) {
+    return nullptr;
+  }
+  pool.reserve(value + 4);
+  Symbol f = unused("f");
+  Symbol x = unused("x");
+  Node *fn = pool.variable(f);
+  Node *body = pool.variable(x);
+  for (uint64_t i = 0; i < value; ++i) {
+    body = pool.application(fn, body);
+  }
+  Node *numeral = pool.lambda(f, pool.lambda(x, body));
+  numbers.emplace(numeral, value);
+  return numeral;
+}
+
+bool ChurchArithmetic::apply(Op op, const uint64_t *args, uint64_t &value) {
+  // Returns false when the result does not fit, or is not a numeral as for exp m 0, which is \x x
+  const uint64_t max = UINT64_MAX;
+  switch (op) {
+    case Op::Succ:
+      if (args[0] == max) {
+        return false;
+      }
+      value = args[0] + 1;
+      return true;
+    case Op::Pred:
+      value = args[0] == 0 ? 0 : args[0] - 1;
+      return true;
+    case Op::Plus:
+      if (args[0] > max - args[1]) {
+        return false;
+      }
+      value = args[0] + args[1];
+      return true;
+    case Op::Mult:
+      if (args[1] != 0 && args[0] > max / args[1]) {
+        return false;
+      }
+      value = args[0] * args[1];
+      return true;
+    case Op::Exp: {
+      uint64_t base = args[0], exponent = args[1];
+      if (exponent == 0) {
+        return false;
+      }
+      if (base <= 1) {
+        value = base;
+        return true;
+      }
+      // Square and multiply; base only grows, so a square that overflows means the result would as well
+      value = 1;
+      while (true) {
+        if (exponent & 1) {
+          if (value > max / base) {
+            return false;
+          }
+          value *= base;
+        }
+        exponent >>= 1;
+        if (exponent == 0) {
+          return true;
+        }
+        if (base > max / base) {
+          return false;
+        }
+        base *= base;
+      }
+    }
+    case Op::IsZero:
+      value = args[0] == 0;
+      return true;
+    case Op::And:
+      value = args[0] && args[1];
+      return true;
+    case Op::Or:
+      value = args[0] || args[1];
+      return true;
+    case Op::Not:
+      value = !args[0];
+      return true;
+  }
+  return false;
+}
@@ -0,0 +1,86 @@
+// church.h
+#ifndef CHURCH_H
+#define CHURCH_H
+
+#include "parser.h"
+#include "pool.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Largest numeral that is built as a term. A larger result is left to ordinary reduction.
+const uint64_t MAX_NUMERAL = 1 << 20;
+
+// Native arithmetic on Church numerals and booleans for the substitution interpreter (-a). An application of a
+// standard combinator (succ, pred, plus, mult, exp, iszero, and, or, not) to numerals or booleans, or to such
+// applications nested in each other, is computed on integers in one step instead of by beta steps. Combinators
+// are recognized up to the names of their variables: by the shape of the lambda first and then by
+// alpha-equivalence with a template. Only the result is turned back into a term, so
+// mult (exp 2 10) (plus 3 4) builds one numeral, with parameters that no other variable of the expression has,
+// so no later substitution into or with the result can capture a name. The result is beta-equivalent to the
+// application and in normal form, which a strategy that does not reduce under lambdas would not always reach.
+class ChurchArithmetic {
+public:
+  ChurchArithmetic();
+
+  // Forgets the numerals of the previous expression, whose nodes are gone with its pool
+  void reset();
+
+  // If node applies a known combinator to as many arithmetic arguments as it takes, returns the result built
+  // in pool; otherwise returns null and node is reduced as usual
+  Node *reduce(Node *node, NodePool &pool);
+
+private:
+  enum class Type : uint8_t {
+    Number, Boolean
+  };
+
+  enum class Op : uint8_t {
+    Succ, Pred, Plus, Mult, Exp, IsZero, And, Or, Not
+  };
+
+  struct Combinator {
+    Node *term;
+    Op op;
+    uint32_t arity;
+    Type argument;
+    Type result;
+  };
+
+  // Step of the evaluation of an arithmetic term: evaluate node as a value of type, or apply op to the
+  // values of its arguments once they are on the value stack
+  struct Task {
+    Node *node;
+    Type type;
+    const Combinator *op;
+  };
+
+  // Holds the templates, which are built once and outlive the pools of the lines
+  NodePool templates;
+  std::vector<Combinator> combinators;
+  // Numbers of the numerals decoded or built during the current expression
+  std::unordered_map<const Node *, uint64_t> numbers;
+  // Kept between calls so their capacity is reused
+  std::vector<Task> tasks;
+  std::vector<uint64_t> values;
+  std::vector<Node *> args;
+  // Suffix of the next name tried by unused
+  unsigned suffix = 0;
+
+  void add(const char *text, Op op, uint32_t arity, Type argument, Type result);
+
+  const Combinator *match(Node *node) const;
+
+  bool decode(Node *node, Type type, uint64_t &value);
+
+  Node *encode(uint64_t value, Type type, NodePool &pool);
+
+  Symbol unused(const std::string &base);
+
+  bool evaluate(Node *node, Type type, uint64_t &value);
+
+  static bool apply(Op op, const uint64_t *args, uint64_t &value);
+};
+
+#endif //CHURCH_H
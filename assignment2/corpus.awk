@@ -0,0 +1,15 @@
+# corpus.awk: prints about mb megabytes of short independent lines for the throughput target of the Makefile.
+# Every line applies a lambda to a few free variables with long names, so one step reduces it and the time
+# goes into reading, parsing and printing rather than reduction.
+# Usage: awk -v mb=2048 -f corpus.awk
+BEGIN {
+  total = mb * 1048576
+  for (line = 0; size < total; line++) {
+    f = "function" line % 89
+    x = "argument" line % 97
+    y = "value" line % 101
+    s = sprintf("(\\%s (\\input ((%s input) (%s %s)))) (%s %s)", x, f, x, y, y, f)
+    print s
+    size += length(s) + 1
+  }
+}
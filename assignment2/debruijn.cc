@@ -0,0 +1,625 @@
+// debruijn.cc
+#include "debruijn.h"
+#include "interpreter.h"
+#include <algorithm>
+
+DeBruijnEngine::DeBruijnEngine(NodePool &pool, int max_iterations, WorkPool *workers, size_t cap)
+    : pool(pool), max_iterations(max_iterations), cap(cap) {
+  if (workers) {
+    own.reset(new Team(*workers));
+    team = own.get();
+  }
+}
+
+DBTerm *DeBruijnEngine::make(DBTerm::Kind kind, uint32_t value, DBTerm *left, DBTerm *right) {
+  uint32_t loose = 0;
+  size_t hash = kind;
+  if (kind == DBTerm::Bound) {
+    loose = value + 1;
+    hash = hash_combine(hash, value);
+  } else if (kind == DBTerm::Free) {
+    hash = hash_combine(hash, value);
+  } else if (kind == DBTerm::Lambda) {
+    loose = left->loose > 0 ? left->loose - 1 : 0;
+    hash = hash_combine(hash, left->hash);
+  } else {
+    loose = left->loose > right->loose ? left->loose : right->loose;
+    hash = hash_combine(hash_combine(hash, left->hash), right->hash);
+  }
+  return arena.make<DBTerm>(DBTerm{kind, 0, value, loose, static_cast<uint32_t>(hash), left, right});
+}
+
+bool DeBruijnEngine::equal(const DBTerm *a, const DBTerm *b) {
+  std::vector<std::pair<const DBTerm *, const DBTerm *>> pending = {{a, b}};
+  while (!pending.empty()) {
+    const DBTerm *x = pending.back().first;
+    const DBTerm *y = pending.back().second;
+    pending.pop_back();
+    if (x == y) {
+      continue;
+    }
+    if (x->kind != y->kind || x->hash != y->hash || x->loose != y->loose) {
+      return false;
+    }
+    if (x->kind == DBTerm::Bound || x->kind == DBTerm::Free) {
+      if (x->value != y->value) {
+        return false;
+      }
+    } else {
+      pending.push_back({x->left, y->left});
+      if (x->kind == DBTerm::Application) {
+        pending.push_back({x->right, y->right});
+      }
+    }
+  }
+  return true;
+}
+
+void DeBruijnEngine::reset() {
+  arena.reset();
+}
+
+Node *DeBruijnEngine::eval(Node *node, int &iterations) {
+  // The terms of the previous expression are no longer needed
+  reset();
+  if (own) {
+    for (auto &helpers : own->helpers) {
+      for (auto &helper : helpers) {
+        helper->reset();
+      }
+    }
+  }
+  std::vector<Symbol> binders;
+  DBTerm *term = from_node(node, binders);
+  return to_node(reduce(term, iterations));
+}
+
+DBTerm *DeBruijnEngine::from_node(Node *node, std::vector<Symbol> &binders) {
+  // Walks down to a variable, then back up through the enclosing nodes on the stack. An application on
+  // the stack is marked once its function is converted and waiting on built. A node that has no variable
+  // named like a binder around it is converted the same wherever it is, so a shared one, as in a DAG loaded
+  // from a term file, is converted once.
+  nodes.clear();
+  built.clear();
+  unbound.clear();
+  uint64_t outer_bits = 0;
+  for (Symbol binder : binders) {
+    outer_bits |= symbol_bit(binder);
+  }
+  bound.assign(1, outer_bits);
+  while (true) {
+    DBTerm *term = nullptr;
+    while (!term) {
+      if (node->kind != NodeKind::Variable && !(node->vars & bound.back())) {
+        auto found = unbound.find(node);
+        if (found != unbound.end()) {
+          term = found->second;
+          break;
+        }
+      }
+      switch (node->kind) {
+        case NodeKind::Variable: {
+          Symbol name = static_cast<VariableNode *>(node)->name;
+          // The innermost binder with this name binds the variable
+          for (size_t i = binders.size(); i > 0 && !term; --i) {
+            if (binders[i - 1] == name) {
+              term = make(DBTerm::Bound, static_cast<uint32_t>(binders.size() - i), nullptr, nullptr);
+            }
+          }
+          if (!term) {
+            term = make(DBTerm::Free, name, nullptr, nullptr);
+          }
+          break;
+        }
+        case NodeKind::Lambda:
+          binders.push_back(static_cast<LambdaNode *>(node)->param);
+          bound.push_back(bound.back() | symbol_bit(binders.back()));
+          nodes.push_back({node, false});
+          node = static_cast<LambdaNode *>(node)->body;
+          break;
+        case NodeKind::Application:
+          nodes.push_back({node, false});
+          node = static_cast<ApplicationNode *>(node)->left;
+          break;
+      }
+    }
+
+    while (true) {
+      if (nodes.empty()) {
+        return term;
+      }
+      std::pair<Node *, bool> &top = nodes.back();
+      if (top.first->kind == NodeKind::Lambda) {
+        binders.pop_back();
+        bound.pop_back();
+        term = make(DBTerm::Lambda, static_cast<LambdaNode *>(top.first)->param, term, nullptr);
+      } else if (!top.second) {
+        // The function is done, convert the argument next
+        built.push_back(term);
+        top.second = true;
+        node = static_cast<ApplicationNode *>(top.first)->right;
+        break;
+      } else {
+        term = make(DBTerm::Application, 0, built.back(), term);
+        built.pop_back();
+      }
+      if (!(top.first->vars & bound.back())) {
+        unbound.emplace(top.first, term);
+      }
+      nodes.pop_back();
+    }
+  }
+}
+
+DBTerm *DeBruijnEngine::reduce(DBTerm *term, int &iterations) {
+  // Same order as Interpreter::eval: function and argument first, never under a lambda.
+  // term is the term of the call to start next, value the result of the call that finished last.
+  DBTerm *value = nullptr;
+  frames.clear();
+  started.clear();
+  active.clear();
+
+  while (true) {
+    if (term) {
+      if (iterations >= max_iterations) {
+        throw std::runtime_error("Maximum number of iterations reached");
+      }
+
+      iterations++;
+      if (!watches.empty() && cancelled()) {
+        throw Cancelled();
+      }
+
+      if (term->kind == DBTerm::Application) {
+        frames.push_back({term, nullptr});
+        term = term->left;
+      } else {
+        value = term;
+        term = nullptr;
+      }
+      continue;
+    }
+
+    if (frames.empty()) {
+      return value;
+    }
+    // The value is passed to the top frame, so every call started above it is done
+    while (!started.empty() && started.back().depth >= frames.size()) {
+      active.erase(started.back());
+      started.pop_back();
+    }
+    Frame &frame = frames.back();
+    if (!frame.left) {
+      // The function is done, the argument is next, unless the application is stuck and its arguments are
+      // reduced in parallel
+      if (team && value->kind != DBTerm::Lambda) {
+        DBTerm *stuck = spine(value, iterations);
+        if (stuck) {
+          value = stuck;
+          continue;
+        }
+      }
+      frame.left = value;
+      term = frame.term->right;
+      continue;
+    }
+    DBTerm *application = frame.term;
+    DBTerm *left = frame.left;
+    frames.pop_back();
+    if (left->kind == DBTerm::Lambda) {
+      term = instantiate(left->left, value, 0);
+      // As in Interpreter::eval, reaching the same term again within the call proves it never returns
+      Start start = {term, frames.size()};
+      bool seen = !active.insert(start).second;
+      for (size_t i = 0; i < outer.size() && !seen; ++i) {
+        seen = outer[i]->count(start) > 0;
+      }
+      if (seen) {
+        throw DivergenceError("Expression does not terminate: the reduction returned to an earlier term");
+      }
+      started.push_back(start);
+    } else if (left != application->left || value != application->right) {
+      value = make(DBTerm::Application, 0, left, value);
+    } else {
+      value = application;
+    }
+  }
+}
+
+DBTerm *DeBruijnEngine::spine(DBTerm *head, int &iterations) {
+  // The function of the top frame is stuck, and so is every application below it whose function is the
+  // application above. Their arguments are reduced by helpers, each in a task of the pool, and the frames
+  // are replaced by the stuck spine. Returns null when fewer than two arguments are worth a task.
+  size_t top = frames.size(), bottom = top - 1;
+  while (bottom > 0 && !frames[bottom - 1].left && frames[bottom - 1].term->left == frames[bottom].term) {
+    --bottom;
+  }
+  std::vector<DBTerm *> arguments;
+  size_t applications = 0;
+  for (size_t i = top; i > bottom; --i) {
+    arguments.push_back(frames[i - 1].term->right);
+    applications += arguments.back()->kind == DBTerm::Application;
+  }
+  if (applications < 2) {
+    return nullptr;
+  }
+
+  // Every helper may use the steps that are not used yet by this engine or a helper that is done. Once an
+  // argument fails, the helpers of the arguments to its right give up, since reduce would never get to them,
+  // while those to its left go on, as one of them may fail first.
+  struct Outcome {
+    int budget = 0;
+    std::exception_ptr error;
+    bool exhausted = false; // The error is the iteration limit, so it depends on the budget
+    bool cancelled = false;
+  };
+  std::vector<DBTerm *> results(arguments);
+  std::vector<int> counts(arguments.size(), 0);
+  std::vector<Outcome> outcomes(arguments.size());
+  std::atomic<int> done(0);
+  std::atomic<size_t> failed(arguments.size());
+  int base = iterations;
+  std::vector<const StartSet *> sets(outer);
+  sets.push_back(&active);
+  team->workers.run(arguments.size(), [&](size_t i) {
+    if (arguments[i]->kind != DBTerm::Application) {
+      return;
+    }
+    Outcome &outcome = outcomes[i];
+    outcome.budget = max_iterations - base - done.load();
+    std::vector<Watch> nested(watches);
+    nested.push_back({&failed, i});
+    try {
+      results[i] = help(arguments[i], counts[i], outcome.budget, sets, nested);
+      done += counts[i];
+      return;
+    } catch (Cancelled &) {
+      outcome.cancelled = true;
+      return;
+    } catch (DivergenceError &) {
+      outcome.error = std::current_exception();
+    } catch (...) {
+      outcome.error = std::current_exception();
+      outcome.exhausted = true;
+    }
+    size_t first = failed.load();
+    while (i < first && !failed.compare_exchange_weak(first, i)) {
+    }
+  });
+  if (cancelled()) {
+    throw Cancelled();
+  }
+
+  // Goes through the arguments in the order of reduce, so the error is the one it would report. A helper that
+  // gave up, or ran out of fewer steps than its argument has in that order, is run again with the right budget.
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    int left = max_iterations - iterations;
+    if (arguments[i]->kind != DBTerm::Application) {
+      // A variable or lambda is a value and takes one step, as in reduce
+      if (left <= 0) {
+        throw std::runtime_error("Maximum number of iterations reached");
+      }
+      iterations++;
+      continue;
+    }
+    const Outcome &outcome = outcomes[i];
+    if (outcome.cancelled || (outcome.exhausted && outcome.budget < left)) {
+      counts[i] = 0;
+      results[i] = help(arguments[i], counts[i], left, sets, watches);
+    } else if (outcome.error && (outcome.exhausted || counts[i] <= left)) {
+      std::rethrow_exception(outcome.error);
+    }
+    iterations += counts[i];
+    if (iterations > max_iterations) {
+      throw std::runtime_error("Maximum number of iterations reached");
+    }
+  }
+
+  DBTerm *value = head;
+  for (size_t i = top; i > bottom; --i) {
+    DBTerm *application = frames[i - 1].term;
+    DBTerm *argument = results[top - i];
+    value = value == application->left && argument == application->right
+            ? application : make(DBTerm::Application, 0, value, argument);
+  }
+  frames.resize(bottom);
+  return value;
+}
+
+DBTerm *DeBruijnEngine::help(DBTerm *term, int &iterations, int budget, const std::vector<const StartSet *> &sets,
+                             const std::vector<Watch> &watches) {
+  // Runs on a thread of the pool, with the first helper of that thread that is not busy
+  unsigned thread = team->workers.index();
+  size_t depth = team->nesting[thread]++;
+  auto &helpers = team->helpers[thread];
+  if (helpers.size() <= depth) {
+    helpers.emplace_back(new DeBruijnEngine(pool));
+    helpers.back()->team = team;
+  }
+  DeBruijnEngine &helper = *helpers[depth];
+  helper.max_iterations = budget;
+  helper.outer = sets;
+  helper.watches = watches;
+  DBTerm *result;
+  try {
+    result = helper.reduce(term, iterations);
+  } catch (...) {
+    --team->nesting[thread];
+    throw;
+  }
+  --team->nesting[thread];
+  return result;
+}
+
+bool DeBruijnEngine::cancelled() const {
+  for (const Watch &watch : watches) {
+    if (watch.failed->load(std::memory_order_relaxed) < watch.index) {
+      return true;
+    }
+  }
+  return false;
+}
+
+DBTerm *DeBruijnEngine::shift(DBTerm *term, uint32_t amount, uint32_t cutoff) {
+  if (amount == 0) {
+    return term;
+  }
+  size_t base = tasks.size();
+  tasks.push_back({term, cutoff, false});
+  while (tasks.size() > base) {
+    Task task = tasks.back();
+    tasks.pop_back();
+    DBTerm *current = task.term;
+    if (task.ready) {
+      if (current->kind == DBTerm::Lambda) {
+        built.back() = make(DBTerm::Lambda, current->value, built.back(), nullptr);
+      } else {
+        DBTerm *right = built.back();
+        built.pop_back();
+        built.back() = make(DBTerm::Application, 0, built.back(), right);
+      }
+    } else if (current->loose <= task.depth) {
+      // Only indices pointing outside the first cutoff lambdas move
+      built.push_back(current);
+    } else if (current->kind == DBTerm::Bound) {
+      built.push_back(make(DBTerm::Bound, current->value + amount, nullptr, nullptr));
+    } else if (current->kind == DBTerm::Lambda) {
+      tasks.push_back({current, task.depth, true});
+      tasks.push_back({current->left, task.depth + 1, false});
+    } else {
+      tasks.push_back({current, task.depth, true});
+      tasks.push_back({current->right, task.depth, false});
+      tasks.push_back({current->left, task.depth, false});
+    }
+  }
+  DBTerm *result = built.back();
+  built.pop_back();
+  return result;
+}
+
+DBTerm *DeBruijnEngine::instantiate(DBTerm *body, DBTerm *value, uint32_t depth) {
+  // Replaces index depth by value and closes the gap left by the removed lambda
+  size_t base = tasks.size();
+  tasks.push_back({body, depth, false});
+  while (tasks.size() > base) {
+    Task task = tasks.back();
+    tasks.pop_back();
+    DBTerm *current = task.term;
+    if (task.ready) {
+      if (current->kind == DBTerm::Lambda) {
+        built.back() = make(DBTerm::Lambda, current->value, built.back(), nullptr);
+      } else {
+        DBTerm *right = built.back();
+        built.pop_back();
+        built.back() = make(DBTerm::Application, 0, built.back(), right);
+      }
+    } else if (current->loose <= task.depth) {
+      built.push_back(current);
+    } else if (current->kind == DBTerm::Bound) {
+      if (current->value == task.depth) {
+        built.push_back(shift(value, task.depth, 0));
+      } else {
+        built.push_back(make(DBTerm::Bound, current->value - 1, nullptr, nullptr));
+      }
+    } else if (current->kind == DBTerm::Lambda) {
+      tasks.push_back({current, task.depth, true});
+      tasks.push_back({current->left, task.depth + 1, false});
+    } else {
+      tasks.push_back({current, task.depth, true});
+      tasks.push_back({current->right, task.depth, false});
+      tasks.push_back({current->left, task.depth, false});
+    }
+  }
+  DBTerm *result = built.back();
+  built.pop_back();
+  return result;
+}
+
+Node *DeBruijnEngine::to_node(DBTerm *term) {
+  std::unordered_set<Symbol> free_names;
+  find_free_names(term, free_names);
+  std::vector<Symbol> names;
+  Node *node = to_node(term, names, free_names);
+  clear_uses(term);
+  reused.clear();
+  context_names.clear();
+  return node;
+}
+
+void DeBruijnEngine::clear_uses(DBTerm *term) {
+  // Only terms that are counted lead to counted terms, so every term is visited once
+  built.clear();
+  built.push_back(term);
+  while (!built.empty()) {
+    DBTerm *current = built.back();
+    built.pop_back();
+    if (current->uses == 0) {
+      continue;
+    }
+    current->uses = 0;
+    if (current->kind == DBTerm::Lambda) {
+      built.push_back(current->left);
+    } else if (current->kind == DBTerm::Application) {
+      built.push_back(current->right);
+      built.push_back(current->left);
+    }
+  }
+}
+
+uint64_t DeBruijnEngine::context(DBTerm *term, const std::vector<Symbol> &names) const {
+  // The names of the binders the term can reach are the last loose ones on the stack
+  size_t end = names.size();
+  size_t start = end - term->loose;
+  return prefixes[end] - prefixes[start] * powers[term->loose];
+}
+
+Node *DeBruijnEngine::to_node(DBTerm *term, std::vector<Symbol> &names, const std::unordered_set<Symbol> &free_names) {
+  // Walks down to a variable, then back up through the enclosing terms on the stack, like from_node.
+  // A shared term is converted once per context: reduction shares subterms, and the tree they unfold to
+  // can be exponentially larger than the term. A conversion that renames a parameter is not reused, since
+  // the fresh name depends on all enclosing binders. The task of a term keeps in depth the number of
+  // renamed parameters before it. The terms come in the order they are printed and every variable and
+  // lambda is at least one character, so once cap of them are converted, the rest of the text is never
+  // printed: from there on such conversions are reused as well. They differ from a new conversion only
+  // in the fresh names, which avoid the free names and the binders the term reaches in any context.
+  const uint64_t base = 0x100000001b3;
+  tasks.clear();
+  converted.clear();
+  uint32_t renamed = 0;
+  size_t printed = 0;
+  prefixes.assign(1, 0);
+  if (powers.empty()) {
+    powers.push_back(1);
+  }
+  if (scopes.size() < symbols().size()) {
+    scopes.resize(symbols().size());
+  }
+  while (true) {
+    Node *node = nullptr;
+    while (!node) {
+      if (term->uses > 1 && term->kind != DBTerm::Bound && term->kind != DBTerm::Free) {
+        auto found = reused.find({term, context(term, names)});
+        if (found != reused.end() &&
+            std::equal(names.end() - term->loose, names.end(), context_names.begin() + found->second.names)) {
+          node = found->second.node;
+          break;
+        }
+      }
+      if (term->kind != DBTerm::Application) {
+        ++printed;
+      }
+      if (term->kind == DBTerm::Bound) {
+        node = pool.variable(names[names.size() - 1 - term->value]);
+      } else if (term->kind == DBTerm::Free) {
+        node = pool.variable(term->value);
+      } else if (term->kind == DBTerm::Lambda) {
+        // Keep the original parameter name unless it would capture a free variable or hide a used binder
+        tasks.push_back({term, renamed, false});
+        Symbol param = term->value;
+        bool conflict = free_names.find(param) != free_names.end();
+        // Only binders the body can reach are checked: the index of the binder at position p in the body
+        // is names.size() - p, and the body has no index of loose or above
+        std::vector<uint32_t> &same = scopes[param];
+        for (size_t j = same.size(); j > 0 && !conflict; --j) {
+          uint32_t index = static_cast<uint32_t>(names.size() - same[j - 1]);
+          if (index >= term->left->loose) {
+            break;
+          }
+          conflict = references(term->left, index);
+        }
+        if (conflict) {
+          std::unordered_set<Symbol> avoid(free_names);
+          avoid.insert(names.begin(), names.end());
+          param = symbols().fresh(param, avoid);
+          scopes.resize(symbols().size());
+          ++renamed;
+        }
+        scopes[param].push_back(static_cast<uint32_t>(names.size()));
+        names.push_back(param);
+        prefixes.push_back(prefixes.back() * base + param + 1);
+        if (powers.size() < prefixes.size()) {
+          powers.push_back(powers.back() * base);
+        }
+        term = term->left;
+      } else {
+        tasks.push_back({term, renamed, false});
+        term = term->left;
+      }
+    }
+
+    while (true) {
+      if (tasks.empty()) {
+        return node;
+      }
+      Task &top = tasks.back();
+      if (top.term->kind == DBTerm::Lambda) {
+        Symbol param = names.back();
+        names.pop_back();
+        prefixes.pop_back();
+        scopes[param].pop_back();
+        node = pool.lambda(param, node);
+      } else if (!top.ready) {
+        // The function is done, convert the argument next
+        converted.push_back(node);
+        top.ready = true;
+        term = top.term->right;
+        break;
+      } else {
+        node = pool.application(converted.back(), node);
+        converted.pop_back();
+      }
+      if ((top.depth == renamed || (cap && printed >= cap)) && top.term->uses > 1) {
+        reused.emplace(Converted{top.term, context(top.term, names)}, ConvertedNode{node, context_names.size()});
+        context_names.insert(context_names.end(), names.end() - top.term->loose, names.end());
+      }
+      tasks.pop_back();
+    }
+  }
+}
+
+bool DeBruijnEngine::references(DBTerm *term, uint32_t index) {
+  // Searches above the tasks of the caller, with depth the index the variable has inside the subterm
+  size_t base = tasks.size();
+  tasks.push_back({term, index, false});
+  bool found = false;
+  while (tasks.size() > base) {
+    Task task = tasks.back();
+    tasks.pop_back();
+    DBTerm *current = task.term;
+    if (found || current->loose <= task.depth) {
+      continue;
+    }
+    if (current->kind == DBTerm::Bound) {
+      found = current->value == task.depth;
+    } else if (current->kind == DBTerm::Lambda) {
+      tasks.push_back({current->left, task.depth + 1, false});
+    } else {
+      tasks.push_back({current->right, task.depth, false});
+      tasks.push_back({current->left, task.depth, false});
+    }
+  }
+  return found;
+}
+
+void DeBruijnEngine::find_free_names(DBTerm *term, std::unordered_set<Symbol> &free_names) {
+  // Also counts the parents of every term in its uses, and visits a shared term only once
+  built.clear();
+  built.push_back(term);
+  while (!built.empty()) {
+    DBTerm *current = built.back();
+    built.pop_back();
+    if (current->uses > 0) {
+      current->uses = 2;
+      continue;
+    }
+    current->uses = 1;
+    if (current->kind == DBTerm::Free) {
+      free_names.insert(current->value);
+    } else if (current->kind == DBTerm::Lambda) {
+      built.push_back(current->left);
+    } else if (current->kind == DBTerm::Application) {
+      built.push_back(current->right);
+      built.push_back(current->left);
+    }
+  }
+}
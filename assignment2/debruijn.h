@@ -0,0 +1,190 @@
+// debruijn.h
+#ifndef DEBRUIJN_H
+#define DEBRUIJN_H
+
+#include "parser.h"
+#include "pool.h"
+#include "interpreter.h"
+#include "arena.h"
+#include "symbol.h"
+#include "workpool.h"
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Term in de Bruijn notation. A bound variable is the number of lambdas between it and its binder,
+// a free variable keeps its symbol. Lambdas remember their parameter name for printing only.
+struct DBTerm {
+  enum Kind : uint8_t {
+    Bound, Free, Lambda, Application
+  };
+
+  Kind kind;
+  uint8_t uses;   // Parents of the term within the result to_node is converting, counted up to 2, otherwise 0
+  uint32_t value; // Bound: index, Free: symbol, Lambda: parameter name
+  uint32_t loose; // One more than the largest index that points outside this term, 0 if there is none
+  uint32_t hash;  // Structural hash without the parameter names, so it is the same for alpha-equivalent terms
+  DBTerm *left;   // Lambda: body, Application: function
+  DBTerm *right;  // Application: argument
+};
+
+// Reduction engine on de Bruijn terms. Substitution shifts indices instead of renaming, so it can never
+// capture a variable and needs no alpha-conversion. Uses the same strategy as Interpreter::eval.
+// With a WorkPool, the arguments of a stuck application are reduced in parallel (see spine). Reduction
+// of a term does not depend on anything outside it and names are only chosen by to_node afterwards, so
+// the result and the number of iterations are the same as without.
+class DeBruijnEngine {
+public:
+  // to_node keeps the names of the first cap characters of the text of the result exactly, 0 for all of it
+  DeBruijnEngine(NodePool &pool, int max_iterations = MAX_ITERATIONS, WorkPool *workers = nullptr, size_t cap = 0);
+
+  Node *eval(Node *node, int &iterations);
+
+  DBTerm *from_node(Node *node, std::vector<Symbol> &binders);
+
+  Node *to_node(DBTerm *term);
+
+  DBTerm *make(DBTerm::Kind kind, uint32_t value, DBTerm *left, DBTerm *right);
+
+  // Compares two terms up to the parameter names
+  static bool equal(const DBTerm *a, const DBTerm *b);
+
+  // Releases the terms of the previous expression
+  void reset();
+
+private:
+  // Pending step of a traversal that rebuilds a term: visit term at depth binders, or (ready) combine the
+  // results of its children into a new term
+  struct Task {
+    DBTerm *term;
+    uint32_t depth;
+    bool ready;
+  };
+
+  // Suspended reduce call, waiting for the function (left is null) or the argument
+  struct Frame {
+    DBTerm *term;
+    DBTerm *left;
+  };
+
+  // Result of a beta step, which continues the call that reduced the application at frame depth
+  struct Start {
+    DBTerm *term;
+    size_t depth;
+  };
+
+  struct StartHash {
+    size_t operator()(const Start &start) const { return start.term->hash; }
+  };
+
+  // Conversion of a shared term by to_node, valid wherever the binders the term reaches have the same names
+  struct Converted {
+    DBTerm *term;
+    uint64_t context; // Hash of the names of the loose innermost binders
+  };
+
+  struct ConvertedHash {
+    size_t operator()(const Converted &key) const { return std::hash<const DBTerm *>()(key.term) ^ key.context; }
+  };
+
+  struct ConvertedEqual {
+    bool operator()(const Converted &a, const Converted &b) const {
+      return a.term == b.term && a.context == b.context;
+    }
+  };
+
+  // Converted node and where the names of its context start in context_names, to rule out a hash collision
+  struct ConvertedNode {
+    Node *node;
+    size_t names;
+  };
+
+  struct StartEqual {
+    bool operator()(const Start &a, const Start &b) const { return equal(a.term, b.term); }
+  };
+
+  typedef std::unordered_set<Start, StartHash, StartEqual> StartSet;
+
+  // Thrown in the helpers of a parallel reduction once an argument to the left of theirs has failed
+  struct Cancelled {};
+
+  // Argument index of a helper within a spine, and the lowest index of an argument of that spine that failed
+  struct Watch {
+    const std::atomic<size_t> *failed;
+    size_t index;
+  };
+
+  // State of a parallel reduction, shared by the engine that owns it and all its helpers
+  struct Team {
+    WorkPool &workers;
+    // Helper engines by thread and by how many helpers the thread is running inside each other, since a
+    // thread waiting for its helpers runs other helpers meanwhile
+    std::vector<std::vector<std::unique_ptr<DeBruijnEngine>>> helpers;
+    std::vector<size_t> nesting;
+
+    explicit Team(WorkPool &workers) : workers(workers), helpers(workers.size()), nesting(workers.size(), 0) {}
+  };
+
+  NodePool &pool;
+  int max_iterations;
+  size_t cap;
+  Arena arena; // Holds the de Bruijn terms of the expression being evaluated
+  // Work stacks of the traversals, kept between calls so their capacity is reused
+  std::vector<Task> tasks;
+  std::vector<DBTerm *> built;
+  std::vector<Frame> frames;
+  // Beta results of the calls in progress of reduce, in the order they were started
+  std::vector<Start> started;
+  StartSet active;
+  // Calls in progress in the engines that wait for this helper, which count as its own for the divergence check
+  std::vector<const StartSet *> outer;
+  // Spines whose arguments this helper is reducing, outermost first; it gives up when one of them no longer
+  // needs its argument
+  std::vector<Watch> watches;
+  std::unique_ptr<Team> own;
+  Team *team = nullptr;
+  std::vector<std::pair<Node *, bool>> nodes;
+  // Bloom filters of the names of the binders around each node on the stack of from_node, and the
+  // conversions of the nodes that have none of those names
+  std::vector<uint64_t> bound;
+  std::unordered_map<Node *, DBTerm *> unbound;
+  std::vector<Node *> converted;
+  // Positions in the name stack of to_node of every name, indexed by symbol, so a parameter is only
+  // compared with the binders of the same name. Each list is empty again after a conversion.
+  std::vector<std::vector<uint32_t>> scopes;
+  // Conversions of the shared terms of the result, see DBTerm::uses
+  std::unordered_map<Converted, ConvertedNode, ConvertedHash, ConvertedEqual> reused;
+  std::vector<Symbol> context_names;
+  // Hashes of the prefixes of the name stack of to_node, and the powers of their base
+  std::vector<uint64_t> prefixes;
+  std::vector<uint64_t> powers;
+
+  DBTerm *reduce(DBTerm *term, int &iterations);
+
+  DBTerm *spine(DBTerm *head, int &iterations);
+
+  DBTerm *help(DBTerm *term, int &iterations, int budget, const std::vector<const StartSet *> &sets,
+              const std::vector<Watch> &watches);
+
+  bool cancelled() const;
+
+  DBTerm *shift(DBTerm *term, uint32_t amount, uint32_t cutoff);
+
+  DBTerm *instantiate(DBTerm *body, DBTerm *value, uint32_t depth);
+
+  Node *to_node(DBTerm *term, std::vector<Symbol> &names, const std::unordered_set<Symbol> &free_names);
+
+  bool references(DBTerm *term, uint32_t index);
+
+  void find_free_names(DBTerm *term, std::unordered_set<Symbol> &free_names);
+
+  uint64_t context(DBTerm *term, const std::vector<Symbol> &names) const;
+
+  void clear_uses(DBTerm *term);
+};
+
+#endif //DEBRUIJN_H
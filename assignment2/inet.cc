@@ -0,0 +1,330 @@
+// inet.cc
+#include "inet.h"
+
+static uint32_t port(uint32_t agent, uint32_t slot) {
+  return agent << 2 | slot;
+}
+
+Node *InteractionNetEngine::eval(Node *node, int &iterations) {
+  // The net and terms of the previous expression are no longer needed
+  terms.reset();
+  agents.clear();
+  lineages.clear();
+  copies.clear();
+  paths.clear();
+  labels = 0;
+  std::vector<Symbol> binders;
+  build(terms.from_node(node, binders));
+  return terms.to_node(readback(iterations));
+}
+
+uint32_t InteractionNetEngine::make(Agent::Kind kind, uint32_t value) {
+  agents.push_back(Agent{kind, false, value, NO_DEPTH, {0, 0, 0}});
+  lineages.push_back(-1);
+  return static_cast<uint32_t>(agents.size() - 1);
+}
+
+void InteractionNetEngine::link(uint32_t a, uint32_t b) {
+  agents[a >> 2].ports[a & 3] = b;
+  agents[b >> 2].ports[b & 3] = a;
+}
+
+void InteractionNetEngine::build(DBTerm *term) {
+  // Every term is connected to the port of its user; the occurrences of a bound variable are collected
+  // until its lambda is done and then shared
+  uint32_t root = make(Agent::Root, 0);
+  builds.clear();
+  binders.clear();
+  builds.push_back({term, port(root, 0), false});
+  while (!builds.empty()) {
+    BuildTask task = builds.back();
+    builds.pop_back();
+    DBTerm *current = task.term;
+    if (task.done) {
+      uint32_t lambda = binders.back();
+      binders.pop_back();
+      share(port(lambda, 1), occurrences[binders.size()]);
+      occurrences[binders.size()].clear();
+      continue;
+    }
+    switch (current->kind) {
+      case DBTerm::Bound:
+        occurrences[binders.size() - 1 - current->value].push_back(task.port);
+        break;
+      case DBTerm::Free:
+        link(port(make(Agent::Free, current->value), 0), task.port);
+        break;
+      case DBTerm::Lambda: {
+        uint32_t lambda = make(Agent::Con, current->value);
+        link(port(lambda, 0), task.port);
+        binders.push_back(lambda);
+        if (occurrences.size() < binders.size()) {
+          occurrences.resize(binders.size());
+        }
+        builds.push_back({current, 0, true});
+        builds.push_back({current->left, port(lambda, 2), false});
+        break;
+      }
+      case DBTerm::Application: {
+        uint32_t application = make(Agent::Con, 0);
+        link(port(application, 2), task.port);
+        builds.push_back({current->right, port(application, 1), false});
+        builds.push_back({current->left, port(application, 0), false});
+        break;
+      }
+    }
+  }
+}
+
+void InteractionNetEngine::share(uint32_t var, std::vector<uint32_t> &uses) {
+  // An unused variable is connected to itself, so an argument passed to it is disconnected from the term
+  if (uses.empty()) {
+    link(var, var);
+    return;
+  }
+  // A balanced tree of fans with a label of their own each, so every occurrence is only a few fans away
+  // from the lambda. Each round joins the ports left by the round before in pairs.
+  while (uses.size() > 1) {
+    size_t joined = 0;
+    for (size_t i = 0; i + 1 < uses.size(); i += 2) {
+      uint32_t fan = make(Agent::Fan, ++labels);
+      link(port(fan, 1), uses[i]);
+      link(port(fan, 2), uses[i + 1]);
+      uses[joined++] = port(fan, 0);
+    }
+    if (uses.size() % 2) {
+      uses[joined++] = uses.back();
+    }
+    uses.resize(joined);
+  }
+  link(var, uses[0]);
+}
+
+bool InteractionNetEngine::interacts(uint32_t a, uint32_t b) const {
+  Agent::Kind x = agents[a].kind, y = agents[b].kind;
+  if (x == Agent::Root || y == Agent::Root) {
+    return false;
+  }
+  // A free variable is only copied; as a function it leaves the application stuck
+  if (x == Agent::Free || y == Agent::Free) {
+    return x == Agent::Fan || y == Agent::Fan;
+  }
+  return true;
+}
+
+bool InteractionNetEngine::copied(uint32_t agent, int32_t copy) const {
+  // Whether agent descends from one of the agents copied by the commutation that made copy
+  if (copy < 0) {
+    return false;
+  }
+  for (int32_t i = lineages[agent]; i >= 0; i = copies[i].parent) {
+    if (copies[i].commutation == copies[copy].commutation) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void InteractionNetEngine::rewrite(uint32_t a, uint32_t b, int &iterations) {
+  if (iterations >= max_iterations) {
+    throw std::runtime_error("Maximum number of iterations reached");
+  }
+  iterations++;
+
+  // The links are made one at a time and every port is looked up after the links before it, so wires
+  // between the two agents themselves end up between the right ports
+  if (agents[a].kind == Agent::Free || agents[b].kind == Agent::Free) {
+    // A fan copies a free variable
+    uint32_t fan = agents[a].kind == Agent::Fan ? a : b;
+    uint32_t symbol = agents[fan == a ? b : a].value;
+    uint32_t first = make(Agent::Free, symbol);
+    uint32_t second = make(Agent::Free, symbol);
+    link(port(first, 0), enter(port(fan, 1)));
+    link(port(second, 0), enter(port(fan, 2)));
+  } else if (agents[a].kind == agents[b].kind && (agents[a].kind == Agent::Con || agents[a].value == agents[b].value)) {
+    // A lambda meets an application (beta step), or two fans with the same label meet: connect the
+    // ports of one to the corresponding ports of the other
+    link(enter(port(a, 1)), enter(port(b, 1)));
+    link(enter(port(a, 2)), enter(port(b, 2)));
+  } else {
+    // The agents copy each other: two copies of b at the other ports of a and two copies of a at the
+    // other ports of b, connected crosswise. If one of them was made while copying an ancestor of the
+    // other, an agent is about to copy a copy of itself.
+    if (copied(a, lineages[b]) || copied(b, lineages[a])) {
+      throw std::runtime_error("The interaction net engine cannot reduce this expression");
+    }
+    Agent x = agents[a], y = agents[b];
+    int32_t from_a = lineages[a], from_b = lineages[b];
+    uint32_t a1 = make(y.kind, y.value), a2 = make(y.kind, y.value);
+    uint32_t b1 = make(x.kind, x.value), b2 = make(x.kind, x.value);
+    uint32_t commutation = static_cast<uint32_t>(copies.size());
+    copies.push_back({commutation, from_b});
+    lineages[a1] = lineages[a2] = static_cast<int32_t>(copies.size() - 1);
+    copies.push_back({commutation, from_a});
+    lineages[b1] = lineages[b2] = static_cast<int32_t>(copies.size() - 1);
+    link(port(a1, 0), enter(port(a, 1)));
+    link(port(a2, 0), enter(port(a, 2)));
+    link(port(b1, 0), enter(port(b, 1)));
+    link(port(b2, 0), enter(port(b, 2)));
+    link(port(a1, 1), port(b1, 1));
+    link(port(a1, 2), port(b2, 1));
+    link(port(a2, 1), port(b1, 2));
+    link(port(a2, 2), port(b2, 2));
+  }
+}
+
+int32_t InteractionNetEngine::pop(int32_t path, uint32_t label, uint32_t &slot) {
+  // The entries above the one for label are copied, so the path of other positions is not changed
+  int32_t found = path;
+  while (found >= 0 && paths[found].label != label) {
+    found = paths[found].next;
+  }
+  if (found < 0) {
+    throw std::runtime_error("The interaction net engine cannot reduce this expression");
+  }
+  slot = paths[found].slot;
+  int32_t rest = paths[found].next;
+  std::vector<PathEntry> above;
+  for (int32_t i = path; i != found; i = paths[i].next) {
+    above.push_back(paths[i]);
+  }
+  for (size_t i = above.size(); i > 0; --i) {
+    paths.push_back({above[i - 1].label, above[i - 1].slot, rest});
+    rest = static_cast<int32_t>(paths.size() - 1);
+  }
+  return rest;
+}
+
+InteractionNetEngine::Head InteractionNetEngine::head(uint32_t start, int32_t start_path, int &iterations) {
+  // Walks from the user port start towards the head of its term: through an application to its function
+  // and through fans along the path. A pair of principal ports met on the way is rewritten and the walk
+  // starts over. A walk without interactions never visits an agent twice, so a longer one means the net
+  // has become cyclic, which only happens to terms the algorithm cannot reduce.
+  size_t steps = 0, mark = paths.size();
+  uint32_t user = start;
+  int32_t path = start_path;
+  Head application = {Head::Application, 0, -1};
+  spine.clear();
+  while (true) {
+    if (++steps > agents.size() + 1) {
+      throw std::runtime_error("The interaction net engine cannot reduce this expression");
+    }
+    uint32_t target = enter(user);
+    uint32_t agent = target >> 2, slot = target & 3;
+    if ((user & 3) == 0 && slot == 0 && interacts(user >> 2, agent)) {
+      rewrite(user >> 2, agent, iterations);
+      // The path entries of this walk are not referenced by anything else
+      paths.resize(mark);
+      user = start;
+      path = start_path;
+      spine.clear();
+      steps = 0;
+      continue;
+    }
+
+    Head found = {Head::Free, agent, path};
+    switch (agents[agent].kind) {
+      case Agent::Root:
+        throw std::runtime_error("The interaction net engine cannot reduce this expression");
+      case Agent::Free:
+        break;
+      case Agent::Con:
+        if (slot == 0) {
+          found.kind = Head::Lambda;
+        } else if (slot == 1) {
+          found.kind = Head::Variable;
+        } else if (spine.empty() && !agents[agent].stuck) {
+          // Reduce the function first: the application is stuck unless it becomes a lambda
+          application = {Head::Application, agent, path};
+          spine.push_back(agent);
+          user = port(agent, 0);
+          continue;
+        } else if (!agents[agent].stuck) {
+          spine.push_back(agent);
+          user = port(agent, 0);
+          continue;
+        } else {
+          found.kind = Head::Application;
+        }
+        break;
+      case Agent::Fan: {
+        if (slot != 0) {
+          paths.push_back({agents[agent].value, slot, path});
+          path = static_cast<int32_t>(paths.size() - 1);
+          user = port(agent, 0);
+        } else {
+          uint32_t exit;
+          path = pop(path, agents[agent].value, exit);
+          user = port(agent, exit);
+        }
+        continue;
+      }
+    }
+
+    if (spine.empty()) {
+      return found;
+    }
+    // The head of the function is not a lambda, so every application on the way is stuck
+    for (uint32_t stuck : spine) {
+      agents[stuck].stuck = true;
+    }
+    return application;
+  }
+}
+
+DBTerm *InteractionNetEngine::readback(int &iterations) {
+  // Reads the normal form from the root, reducing the net wherever a position is read. A net that is not
+  // reduced correctly can be cyclic and read back forever, so the positions read are limited too, by a
+  // bound that does not depend on the interaction limit so the stacks cannot outgrow memory.
+  size_t positions = 0;
+  reads.clear();
+  built.clear();
+  reads.push_back({ReadTask::Position, port(0, 0), -1, 0});
+  while (!reads.empty()) {
+    ReadTask task = reads.back();
+    reads.pop_back();
+    if (task.kind == ReadTask::Position && ++positions > MAX_POSITIONS) {
+      throw std::runtime_error("The interaction net engine cannot reduce this expression");
+    }
+    switch (task.kind) {
+      case ReadTask::Lambda: {
+        Agent &lambda = agents[task.port];
+        lambda.depth = static_cast<uint32_t>(task.path);
+        built.back() = terms.make(DBTerm::Lambda, lambda.value, built.back(), nullptr);
+        break;
+      }
+      case ReadTask::Application: {
+        DBTerm *right = built.back();
+        built.pop_back();
+        built.back() = terms.make(DBTerm::Application, 0, built.back(), right);
+        break;
+      }
+      case ReadTask::Position: {
+        size_t mark = paths.size();
+        Head found = head(task.port, task.path, iterations);
+        Agent &agent = agents[found.agent];
+        if (found.kind == Head::Lambda) {
+          // A lambda can be read again inside its own body along another path, so its depth is restored
+          reads.push_back({ReadTask::Lambda, found.agent, static_cast<int32_t>(agent.depth), 0});
+          agent.depth = task.depth;
+          reads.push_back({ReadTask::Position, port(found.agent, 2), found.path, task.depth + 1});
+        } else if (found.kind == Head::Variable) {
+          if (agent.depth == NO_DEPTH || agent.depth >= task.depth) {
+            throw std::runtime_error("The interaction net engine cannot reduce this expression");
+          }
+          built.push_back(terms.make(DBTerm::Bound, task.depth - agent.depth - 1, nullptr, nullptr));
+          paths.resize(mark);
+        } else if (found.kind == Head::Free) {
+          built.push_back(terms.make(DBTerm::Free, agent.value, nullptr, nullptr));
+          paths.resize(mark);
+        } else {
+          reads.push_back({ReadTask::Application, 0, -1, 0});
+          reads.push_back({ReadTask::Position, port(found.agent, 1), found.path, task.depth});
+          reads.push_back({ReadTask::Position, port(found.agent, 0), found.path, task.depth});
+        }
+        break;
+      }
+    }
+  }
+  return built.back();
+}
@@ -0,0 +1,145 @@
+// inet.h
+#ifndef INET_H
+#define INET_H
+
+#include "parser.h"
+#include "pool.h"
+#include "debruijn.h"
+#include "interpreter.h"
+#include <cstdint>
+#include <vector>
+
+// Agent of an interaction net. A port is the index of its agent times four plus its slot, where slot 0 is
+// the principal port. Lambdas and applications are the same kind of agent: a lambda is wired with its
+// principal port to its user, slot 1 to the occurrences of its variable and slot 2 to its body, an
+// application with its principal port to the function, slot 1 to the argument and slot 2 to its user.
+struct Agent {
+  enum Kind : uint8_t {
+    Root, // Holds the whole term at its principal port and never interacts
+    Con,  // Lambda or application
+    Fan,  // Duplicator: shares what is at its principal port between its two other ports
+    Free  // Free variable
+  };
+
+  Kind kind;
+  bool stuck;      // Con used as an application whose function is known to be a variable
+  uint32_t value;  // Con: parameter name of a lambda, Fan: label, Free: symbol
+  uint32_t depth;  // Con: number of lambdas around this lambda in the readback, NO_DEPTH if not read
+  uint32_t ports[3];
+};
+
+// Optimal (Lamping-style) reduction engine. The term is translated into an interaction net where every
+// variable used more than once is shared by a tree of fans. Reduction only rewrites pairs of agents that
+// are connected by their principal ports, so a duplicated function is copied lazily, one agent at a time,
+// and work inside it is shared between the copies. Fans with the same label annihilate and others copy
+// each other; this is the algorithm without Lamping's oracle, which labels fans per variable instead of
+// tracking levels with brackets and croissants. It is exact as long as no fan duplicates a copy of itself,
+// which covers terms like Church arithmetic, but may read back a wrong term for others. Two agents that
+// meet again after one was copied while copying an ancestor of the other are such a case: it would copy
+// forever, so the engine stops and reports that it cannot reduce the expression. The net is
+// reduced lazily by the readback, so only interactions the normal form needs are done, and the result is
+// the full normal form, like the normal order strategy of the interpreter. An interaction counts as an
+// iteration.
+class InteractionNetEngine {
+public:
+  // cap is passed on to the conversion of the result, see DeBruijnEngine
+  InteractionNetEngine(NodePool &pool, int max_iterations = MAX_ITERATIONS, size_t cap = 0)
+      : terms(pool, MAX_ITERATIONS, nullptr, cap), max_iterations(max_iterations) {}
+
+  Node *eval(Node *node, int &iterations);
+
+private:
+  // Agent a read back position is on: the head of its term
+  struct Head {
+    enum Kind : uint8_t {
+      Lambda, Variable, Free, Application
+    };
+
+    Kind kind;
+    uint32_t agent;
+    int32_t path; // Fan path at the head, for reading its subterms
+  };
+
+  // Ports taken at fans on the way to a position, as a persistent list, so positions can share a prefix.
+  // Reaching a fan through one of its other ports pushes that port; reaching it through its principal port
+  // leaves through the port on top for its label.
+  struct PathEntry {
+    uint32_t label;
+    uint32_t slot;
+    int32_t next;
+  };
+
+  // Pending step of the translation: connect term to port, or (done) share the variable of a lambda
+  struct BuildTask {
+    DBTerm *term;
+    uint32_t port;
+    bool done;
+  };
+
+  // Pending step of the readback: read the term whose user is port, or build a lambda or application
+  // from the terms read before
+  struct ReadTask {
+    enum Kind : uint8_t {
+      Position, Lambda, Application
+    };
+
+    Kind kind;
+    uint32_t port;  // Position: the port; Lambda: the lambda agent
+    int32_t path;   // Position: fan path; Lambda: depth to restore on the agent
+    uint32_t depth; // Position: number of lambdas around it
+  };
+
+  // Commutation that made a copied agent, and the record of the agent it is a copy of, -1 for an agent of
+  // the translated term
+  struct Copy {
+    uint32_t commutation;
+    int32_t parent;
+  };
+
+  static const uint32_t NO_DEPTH = ~uint32_t(0);
+
+  // Most positions a readback reads. A larger one is taken for a cyclic net that reads back forever: its
+  // normal form would be a tree of millions of nodes, which is far more than the expressions the engine
+  // is meant for read back to.
+  static const size_t MAX_POSITIONS = 1 << 22;
+
+  DeBruijnEngine terms; // Converts between nodes and de Bruijn terms
+  int max_iterations;
+  uint32_t labels = 0;
+  std::vector<Agent> agents;
+  // Record in copies of every agent. It is kept apart from the agents, which the readback walks.
+  std::vector<int32_t> lineages;
+  std::vector<Copy> copies;
+  std::vector<PathEntry> paths;
+  // Work stacks of the translation, walk and readback, kept between calls so their capacity is reused
+  std::vector<BuildTask> builds;
+  std::vector<uint32_t> binders;
+  std::vector<std::vector<uint32_t>> occurrences;
+  std::vector<uint32_t> spine;
+  std::vector<ReadTask> reads;
+  std::vector<DBTerm *> built;
+
+  uint32_t make(Agent::Kind kind, uint32_t value);
+
+  uint32_t enter(uint32_t port) const { return agents[port >> 2].ports[port & 3]; }
+
+  void link(uint32_t a, uint32_t b);
+
+  void build(DBTerm *term);
+
+  void share(uint32_t port, std::vector<uint32_t> &uses);
+
+  bool interacts(uint32_t a, uint32_t b) const;
+
+  bool copied(uint32_t agent, int32_t copy) const;
+
+  void rewrite(uint32_t a, uint32_t b, int &iterations);
+
+  int32_t pop(int32_t path, uint32_t label, uint32_t &slot);
+
+  Head head(uint32_t port, int32_t path, int &iterations);
+
+  DBTerm *readback(int &iterations);
+};
+
+#endif //INET_H
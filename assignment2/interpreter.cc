@@ -1,121 +1,381 @@
 #include "interpreter.h"
+#include "church.h"
 
-const int MAX_ITERATIONS = 10000;
-
-std::string
-Interpreter::is_conflict(std::unordered_set<std::string> bound_vars, const std::unordered_set<std::string> &free_vars) {
-  // Check if a free var is found in bound var
-  for (auto &var: free_vars) {
+Symbol InterpreterBase::is_conflict(const std::unordered_set<Symbol> &bound_vars) const {
+  // Check if a free var of the last find_free_vars is found in bound var. Only one conflict is renamed per
+  // redex, so when there are several the choice shows in the result. It is the one the string sets of the
+  // original version met first: the first in an unordered_set<std::string> of the free names, filled in the
+  // order they occur.
+  Symbol conflict = NO_SYMBOL;
+  size_t count = 0;
+  for (Symbol var: free_order) {
+    if (bound_vars.find(var) != bound_vars.end()) {
+      conflict = var;
+      ++count;
+    }
+  }
+  if (count <= 1) {
+    return conflict;
+  }
+  std::unordered_set<std::string> names;
+  for (Symbol var: free_order) {
+    names.insert(symbols().name(var));
+  }
+  for (auto &name: names) {
+    Symbol var = symbols().intern(name);
     if (bound_vars.find(var) != bound_vars.end()) {
       return var;
     }
   }
-  return "";
+  return conflict;
 }
 
-Node *Interpreter::beta_reduction(LambdaNode *lambda, Node *argument, std::unordered_set<std::string> &bound_vars,
-                                  std::unordered_set<std::string> &free_vars) {
-  find_bound_vars(lambda->body, bound_vars);
-  find_free_vars(argument, free_vars);
+Node *InterpreterBase::beta_reduction(LambdaNode *lambda, Node *argument, std::unordered_set<Symbol> &bound_vars,
+                                  std::unordered_set<Symbol> &free_vars) {
+  Node *body = lambda->body;
+  // The summaries prove most redexes free of conflicts, without collecting the variables of body and argument
+  if (body->binders & argument->vars) {
+    find_bound_vars(body, bound_vars);
+    find_free_vars(argument, free_vars);
 
-  // Perform alpha conversion if necessary on the body of the lambda
-  std::string conflict = is_conflict(bound_vars, free_vars);
-  if (!conflict.empty()) {
-    lambda->body = alpha_conversion(lambda->body, conflict, bound_vars);
+    // Perform alpha conversion if necessary on the body of the lambda
+    Symbol conflict = is_conflict(bound_vars);
+    if (conflict != NO_SYMBOL) {
+      body = alpha_conversion(body, conflict, bound_vars);
+    }
   }
 
-  Node *subst = substitute(lambda->body->copy(), lambda->param, argument, bound_vars);
+  // Nodes are immutable, so the body is shared rather than copied
+  Node *subst = substitute(body, lambda->param, argument, bound_vars);
 
   return subst;
 }
 
-Node *Interpreter::alpha_conversion(Node *body, std::string &param, std::unordered_set<std::string> &bound_vars) {
-  std::string new_var = unique_var(param, bound_vars);
+Node *InterpreterBase::alpha_conversion(Node *body, Symbol param, std::unordered_set<Symbol> &bound_vars) {
+  Symbol new_var = unique_var(param, bound_vars);
   // Substitute all occurrences of param with new_var
-  body = substitute(body, param, new VariableNode{new_var}, bound_vars);
-  if (auto l = dynamic_cast<LambdaNode *>(body)) {
-    l->param = new_var;
+  body = substitute(body, param, pool.variable(new_var), bound_vars);
+  if (body->kind == NodeKind::Lambda) {
+    body = pool.lambda(new_var, static_cast<LambdaNode *>(body)->body);
   }
   return body;
 }
 
 
-Node *Interpreter::eval(Node *node, int &iterations) {
-  if (iterations >= MAX_ITERATIONS) {
-    throw std::runtime_error("Maximum number of iterations reached");
+Node *
+InterpreterBase::substitute(Node *node, Symbol var, Node *value, std::unordered_set<Symbol> &bound_vars) {
+  // Substitute all var with value, rebuilding only the nodes on a path to an occurrence.
+  // Subterms whose summary does not contain var are returned as they are without being visited.
+  // A node is pushed twice: once to schedule its children, then (as null followed by the node) to rebuild
+  // it from the results of its children.
+  uint64_t bit = symbol_bit(var);
+  if (!(node->vars & bit)) {
+    return node;
+  }
+  size_t base = pending.size();
+  size_t first = results.size();
+  pending.push_back(node);
+  while (pending.size() > base) {
+    Node *current = pending.back();
+    pending.pop_back();
+    if (current && !(current->vars & bit)) {
+      results.push_back(current);
+      continue;
+    }
+    if (!current) {
+      current = pending.back();
+      pending.pop_back();
+      if (current->kind == NodeKind::Lambda) {
+        auto l = static_cast<LambdaNode *>(current);
+        Node *body = results.back();
+        results.back() = body == l->body ? current : pool.lambda(l->param, body);
+      } else {
+        auto a = static_cast<ApplicationNode *>(current);
+        Node *right = results.back();
+        results.pop_back();
+        Node *left = results.back();
+        results.back() = left == a->left && right == a->right ? current : pool.application(left, right);
+      }
+      continue;
+    }
+    switch (current->kind) {
+      case NodeKind::Variable:
+        results.push_back(static_cast<VariableNode *>(current)->name == var ? value : current);
+        break;
+      case NodeKind::Lambda: {
+        auto l = static_cast<LambdaNode *>(current);
+        // If the variable is bound, no substitution
+        if (l->param == var) {
+          results.push_back(current);
+          break;
+        }
+        pending.push_back(current);
+        pending.push_back(nullptr);
+        pending.push_back(l->body);
+        break;
+      }
+      case NodeKind::Application: {
+        auto a = static_cast<ApplicationNode *>(current);
+        // Substitute in left and right nodes
+        pending.push_back(current);
+        pending.push_back(nullptr);
+        pending.push_back(a->right);
+        pending.push_back(a->left);
+        break;
+      }
+    }
   }
+  Node *result = results[first];
+  results.pop_back();
+  return result;
+}
 
-  iterations++;
+Symbol InterpreterBase::unique_var(Symbol var, const std::unordered_set<Symbol> &bound_vars) {
+  // Generate a new unique variable name by appending a number to the original variable name
+  if (bound_vars.find(var) == bound_vars.end()) {
+    return var;
+  }
+  return symbols().fresh(var, bound_vars);
+}
 
-  std::unordered_set<std::string> bound_vars = {};
-  std::unordered_set<std::string> free_vars = {};
-  // Evaluate the left and right nodes
-  if (auto a = dynamic_cast<ApplicationNode *>(node)) {
-    Node *left = eval(a->left->copy(), iterations);
-    Node *right = eval(a->right->copy(), iterations);
-    // If the left node is a lambda, perform beta reduction
-    if (auto l = dynamic_cast<LambdaNode *>(left)) {
-      Node *subst = beta_reduction(l, right, bound_vars, free_vars);
-      delete left;
-      delete right;
-      return eval(subst, iterations);
+void InterpreterBase::find_bound_vars(Node *node, std::unordered_set<Symbol> &bound_vars) {
+  size_t base = pending.size();
+  pending.push_back(node);
+  while (pending.size() > base) {
+    Node *current = pending.back();
+    pending.pop_back();
+    switch (current->kind) {
+      case NodeKind::Variable:
+        break;
+      case NodeKind::Lambda:
+        bound_vars.insert(static_cast<LambdaNode *>(current)->param);
+        pending.push_back(static_cast<LambdaNode *>(current)->body);
+        break;
+      case NodeKind::Application:
+        // A subterm without lambdas adds nothing
+        if (static_cast<ApplicationNode *>(current)->right->binders) {
+          pending.push_back(static_cast<ApplicationNode *>(current)->right);
+        }
+        if (static_cast<ApplicationNode *>(current)->left->binders) {
+          pending.push_back(static_cast<ApplicationNode *>(current)->left);
+        }
+        break;
     }
-    return new ApplicationNode{left, right};
   }
-
-  return node->copy();
 }
 
+void InterpreterBase::find_free_vars(Node *node, std::unordered_set<Symbol> &free_vars) {
+  free_order.clear();
+  size_t base = pending.size();
+  pending.push_back(node);
+  while (pending.size() > base) {
+    Node *current = pending.back();
+    pending.pop_back();
+    switch (current->kind) {
+      case NodeKind::Variable:
+        if (free_vars.insert(static_cast<VariableNode *>(current)->name).second) {
+          free_order.push_back(static_cast<VariableNode *>(current)->name);
+        }
+        break;
+      case NodeKind::Lambda:
+        pending.push_back(static_cast<LambdaNode *>(current)->body);
+        break;
+      case NodeKind::Application:
+        pending.push_back(static_cast<ApplicationNode *>(current)->right);
+        pending.push_back(static_cast<ApplicationNode *>(current)->left);
+        break;
+    }
+  }
+}
 
-Node *
-Interpreter::substitute(Node *node, const std::string &var, Node *value, std::unordered_set<std::string> &bound_vars) {
-  // Substitute all var with value
-  if (auto v = dynamic_cast<VariableNode *>(node)) {
-    if (v->name == var) {
-      return value->copy();
-    }
-    return new VariableNode{v->name};
-  } else if (auto l = dynamic_cast<LambdaNode *>(node)) {
-    // If the variable is bound, no substitution
-    if (l->param == var) {
-      return new LambdaNode{l->param, l->body->copy()};
-    }
-    auto new_body = substitute(l->body, var, value, bound_vars);
-    return new LambdaNode{l->param, new_body};
-  } else if (auto a = dynamic_cast<ApplicationNode *>(node)) {
-    // Substitute in left and right nodes
-    return new ApplicationNode{substitute(a->left, var, value, bound_vars),substitute(a->right, var, value, bound_vars)};
-  }
-  return node->copy();
+bool InterpreterBase::alpha_equivalent(Node *a, Node *b) {
+  // Walks both nodes together on an explicit stack, where a null pair marks the end of a lambda body.
+  // Two variables match if the innermost binder of either binds both, or if both are free with one name.
+  if (a == b) {
+    return true;
+  }
+  std::vector<std::pair<Node *, Node *>> pending = {{a, b}};
+  std::vector<std::pair<Symbol, Symbol>> binders;
+  while (!pending.empty()) {
+    Node *x = pending.back().first;
+    Node *y = pending.back().second;
+    pending.pop_back();
+    if (!x) {
+      binders.pop_back();
+      continue;
+    }
+    if (x->kind != y->kind || x->shape != y->shape) {
+      return false;
+    }
+    switch (x->kind) {
+      case NodeKind::Variable: {
+        Symbol nx = static_cast<VariableNode *>(x)->name;
+        Symbol ny = static_cast<VariableNode *>(y)->name;
+        size_t i = binders.size();
+        while (i > 0 && binders[i - 1].first != nx && binders[i - 1].second != ny) {
+          --i;
+        }
+        if (i == 0 ? nx != ny : binders[i - 1].first != nx || binders[i - 1].second != ny) {
+          return false;
+        }
+        break;
+      }
+      case NodeKind::Lambda:
+        binders.push_back({static_cast<LambdaNode *>(x)->param, static_cast<LambdaNode *>(y)->param});
+        pending.push_back({nullptr, nullptr});
+        pending.push_back({static_cast<LambdaNode *>(x)->body, static_cast<LambdaNode *>(y)->body});
+        break;
+      case NodeKind::Application:
+        pending.push_back({static_cast<ApplicationNode *>(x)->right, static_cast<ApplicationNode *>(y)->right});
+        pending.push_back({static_cast<ApplicationNode *>(x)->left, static_cast<ApplicationNode *>(y)->left});
+        break;
+    }
+  }
+  return true;
 }
 
-std::string Interpreter::unique_var(const std::string &var, const std::unordered_set<std::string> &bound_vars) {
-  // Generate a new unique variable name by appending a number to the original variable name
-  std::string new_var = var;
-  int counter = 1;
-  while (bound_vars.find(new_var) != bound_vars.end()) {
-    new_var = var + std::to_string(counter++);
+template<typename Strategy>
+void Interpreter<Strategy>::enter(Node *node, bool head_only) {
+  // Reduction is deterministic and does not depend on names, so a call that reaches an alpha-equivalent
+  // term in the same mode, either as its own continuation or in a call it is waiting for, never returns
+  Start start = {node, head_only, frames.size()};
+  if (!active.insert(start).second) {
+    throw DivergenceError("Expression does not terminate: the reduction returned to an earlier term");
   }
-  return new_var;
+  started.push_back(start);
 }
 
-void Interpreter::find_bound_vars(Node *node, std::unordered_set<std::string> &bound_vars) {
-  if (auto l = dynamic_cast<LambdaNode *>(node)) {
-    bound_vars.insert(l->param);
-    find_bound_vars(l->body, bound_vars);
-  } else if (auto a = dynamic_cast<ApplicationNode *>(node)) {
-    find_bound_vars(a->left, bound_vars);
-    find_bound_vars(a->right, bound_vars);
+template<typename Strategy>
+void Interpreter<Strategy>::leave() {
+  // A value is passed to the top frame, so every call started above it is done
+  while (!started.empty() && started.back().depth >= frames.size()) {
+    active.erase(started.back());
+    started.pop_back();
   }
 }
 
-void Interpreter::find_free_vars(Node *node, std::unordered_set<std::string> &free_vars) {
-  if (auto v = dynamic_cast<VariableNode *>(node)) {
-    free_vars.insert(v->name);
-  } else if (auto l = dynamic_cast<LambdaNode *>(node)) {
-    find_free_vars(l->body, free_vars);
-  } else if (auto a = dynamic_cast<ApplicationNode *>(node)) {
-    find_free_vars(a->left, free_vars);
-    find_free_vars(a->right, free_vars);
+template<typename Strategy>
+Node *Interpreter<Strategy>::application(ApplicationNode *node, Node *left, Node *right) {
+  return left == node->left && right == node->right ? node : pool.application(left, right);
+}
+
+template<typename Strategy>
+Node *Interpreter<Strategy>::eval(Node *node, int &iterations) {
+  // node is the term of the call to start next, value the result of the call that finished last
+  Node *value = nullptr;
+  bool head_only = false; // The call to start is whnf: reduce the head only
+  frames.clear();
+  started.clear();
+  active.clear();
+  if (arithmetic) {
+    arithmetic->reset();
   }
-}
\ No newline at end of file
+
+  while (true) {
+    if (node) {
+      if (iterations >= max_iterations) {
+        throw std::runtime_error("Maximum number of iterations reached");
+      }
+
+      iterations++;
+
+      // An arithmetic application is one step, and its result is a numeral or boolean in normal form
+      Node *computed = arithmetic && node->kind == NodeKind::Application ? arithmetic->reduce(node, pool) : nullptr;
+      if (computed) {
+        value = computed;
+        node = nullptr;
+      } else if (node->kind == NodeKind::Application) {
+        // Evaluate the left node first; a lazy strategy only needs to know whether it becomes a lambda
+        frames.push_back({head_only ? Frame::Head : Frame::Function, node, nullptr, nullptr});
+        head_only = head_only || !Strategy::strict;
+        node = static_cast<ApplicationNode *>(node)->left;
+      } else if (node->kind == NodeKind::Lambda && Strategy::under_lambda && !head_only) {
+        frames.push_back({Frame::Body, node, nullptr, nullptr});
+        node = static_cast<LambdaNode *>(node)->body;
+      } else {
+        value = node;
+        node = nullptr;
+      }
+      continue;
+    }
+
+    if (frames.empty()) {
+      return value;
+    }
+    leave();
+    Frame &frame = frames.back();
+    if (frame.step == Frame::Body) {
+      auto l = static_cast<LambdaNode *>(frame.node);
+      value = value == l->body ? frame.node : pool.lambda(l->param, value);
+      frames.pop_back();
+      continue;
+    }
+    auto a = static_cast<ApplicationNode *>(frame.node);
+    Node *left = frame.left;
+    Node *right = a->right;
+
+    switch (frame.step) {
+      case Frame::Body:
+        break;
+      case Frame::Head:
+        frames.pop_back();
+        if (value->kind == NodeKind::Lambda) {
+          std::unordered_set<Symbol> bound_vars = {};
+          std::unordered_set<Symbol> free_vars = {};
+          node = beta_reduction(static_cast<LambdaNode *>(value), right, bound_vars, free_vars);
+          enter(node, head_only);
+        } else {
+          value = application(a, value, right);
+        }
+        continue;
+      case Frame::Function:
+        if (Strategy::strict) {
+          frame.left = value;
+          frame.step = Frame::Argument;
+          node = right;
+          head_only = false;
+          continue;
+        }
+        left = value;
+        break;
+      case Frame::Argument:
+        right = value;
+        break;
+      case Frame::StuckLeft:
+        frame.left = value;
+        frame.step = Frame::StuckRight;
+        node = frame.right;
+        head_only = false;
+        continue;
+      case Frame::StuckRight:
+        value = application(a, left, value);
+        frames.pop_back();
+        continue;
+    }
+
+    // Both sides of the application are done: if the left node is a lambda, perform beta reduction
+    head_only = false;
+    if (left->kind == NodeKind::Lambda) {
+      frames.pop_back();
+      std::unordered_set<Symbol> bound_vars = {};
+      std::unordered_set<Symbol> free_vars = {};
+      node = beta_reduction(static_cast<LambdaNode *>(left), right, bound_vars, free_vars);
+      enter(node, head_only);
+    } else if (Strategy::stuck_args && !Strategy::strict) {
+      frame.left = left;
+      frame.right = right;
+      frame.step = Frame::StuckLeft;
+      node = left;
+    } else {
+      value = application(a, left, right);
+      frames.pop_back();
+    }
+  }
+}
+
+template class Interpreter<CallByValue>;
+template class Interpreter<ApplicativeOrder>;
+template class Interpreter<CallByName>;
+template class Interpreter<NormalOrder>;
+template class Interpreter<HeadNormalForm>;
+template class Interpreter<WeakHeadNormalForm>;
@@ -2,25 +2,146 @@
 #define INTERPRETER_H
 
 #include "parser.h"
+#include "pool.h"
+#include "symbol.h"
+#include <stdexcept>
+#include <string>
 #include <unordered_set>
+#include <vector>
 
-class Interpreter {
+class ChurchArithmetic;
+
+// Default limit on the number of reduction steps of one expression, changed with -n
+const int MAX_ITERATIONS = 10000;
+
+// Thrown when the reduction is proven not to terminate, before the iteration limit is reached
+class DivergenceError : public std::runtime_error {
+public:
+  explicit DivergenceError(const std::string &what) : std::runtime_error(what) {}
+};
+
+// Reduction strategies, used as compile-time policies of Interpreter.
+// strict: reduce the argument before the beta step
+// under_lambda: reduce the body of a lambda
+// stuck_args: reduce the arguments of an application whose function does not reduce to a lambda
+struct CallByValue {
+  static const bool strict = true, under_lambda = false, stuck_args = true;
+};
+
+struct ApplicativeOrder {
+  static const bool strict = true, under_lambda = true, stuck_args = true;
+};
+
+struct CallByName {
+  static const bool strict = false, under_lambda = false, stuck_args = true;
+};
+
+struct NormalOrder {
+  static const bool strict = false, under_lambda = true, stuck_args = true;
+};
+
+struct HeadNormalForm {
+  static const bool strict = false, under_lambda = true, stuck_args = false;
+};
+
+struct WeakHeadNormalForm {
+  static const bool strict = false, under_lambda = false, stuck_args = false;
+};
+
+// Substitution machinery shared by all strategies
+class InterpreterBase {
 public:
+  explicit InterpreterBase(NodePool &pool) : pool(pool) {}
+
+  Node *substitute(Node *node, Symbol var, Node *value, std::unordered_set<Symbol> &bound_vars);
+
+  static Symbol unique_var(Symbol var, const std::unordered_set<Symbol> &bound_vars);
+
+  void find_bound_vars(Node *node, std::unordered_set<Symbol> &bound_vars);
+
+  Node *alpha_conversion(Node *body, Symbol param, std::unordered_set<Symbol> &bound_vars);
+
+  Symbol is_conflict(const std::unordered_set<Symbol> &bound_vars) const;
+
+  Node *beta_reduction(LambdaNode *lambda, Node *argument, std::unordered_set<Symbol> &bound_vars, std::unordered_set<Symbol> &free_vars);
+
+  void find_free_vars(Node *node, std::unordered_set<Symbol> &free_vars);
+
+  static bool alpha_equivalent(Node *a, Node *b);
+
+protected:
+  // Shared with the parser, so every node of a line is released by one reset
+  NodePool &pool;
+
+private:
+  // Work stacks of the traversals. They replace the native call stack, so the depth of a term is
+  // limited by memory only, and they are kept between calls so their capacity is reused.
+  std::vector<Node *> pending;
+  std::vector<Node *> results;
+  // Names added by the last find_free_vars, in the order they first occur
+  std::vector<Symbol> free_order;
+};
+
+// Substitution interpreter. Every strategy is a separate instantiation, so the checks on the policy are
+// resolved at compile time and the reduction loop of each strategy has no runtime dispatch.
+template<typename Strategy>
+class Interpreter : public InterpreterBase {
+public:
+  // With arithmetic, applications of Church arithmetic are computed natively instead of by beta steps
+  Interpreter(NodePool &pool, int max_iterations = MAX_ITERATIONS, ChurchArithmetic *arithmetic = nullptr)
+      : InterpreterBase(pool), max_iterations(max_iterations), arithmetic(arithmetic) {}
+
   Node *eval(Node *node, int &iterations);
 
-  Node *substitute(Node *node, const std::string &var, Node *value, std::unordered_set<std::string> &bound_vars);
+private:
+  // Suspended eval or whnf (head only) call, waiting for the result of a call on a subterm. Eval runs all
+  // calls in one loop on this stack, so the depth of a term is not limited by the native stack.
+  struct Frame {
+    enum Step : uint8_t {
+      Body,       // eval of the lambda body
+      Function,   // eval or whnf of the function
+      Argument,   // eval of the argument, strict strategies only
+      StuckLeft,  // eval of the function of a stuck application
+      StuckRight, // eval of the argument of a stuck application
+      Head        // whnf of the function, inside a whnf call
+    };
+
+    Step step;
+    Node *node;
+    Node *left;  // Function: its result; StuckLeft, StuckRight: the reduced function
+    Node *right; // StuckLeft: the argument still to be reduced
+  };
+
+  // Result of a beta step, which continues the call that reduced the application at frame depth.
+  // The call is in progress until its value is passed to the frame below depth.
+  struct Start {
+    Node *node;
+    bool head_only;
+    size_t depth;
+  };
 
-  static std::string unique_var(const std::string &var, const std::unordered_set<std::string> &bound_vars);
+  struct StartHash {
+    size_t operator()(const Start &start) const { return start.node->shape * 2 + start.head_only; }
+  };
 
-  void find_bound_vars(Node *node, std::unordered_set<std::string> &bound_vars);
+  struct StartEqual {
+    bool operator()(const Start &a, const Start &b) const {
+      return a.head_only == b.head_only && alpha_equivalent(a.node, b.node);
+    }
+  };
 
-  Node *alpha_conversion(Node *body, std::string &param, std::unordered_set<std::string> &bound_vars);
+  int max_iterations;
+  ChurchArithmetic *arithmetic;
+  std::vector<Frame> frames;
+  // Beta results of the calls in progress, in the order they were started
+  std::vector<Start> started;
+  std::unordered_set<Start, StartHash, StartEqual> active;
 
-  static std::string is_conflict(std::unordered_set<std::string> bound_vars, const std::unordered_set<std::string> &free_vars);
+  Node *application(ApplicationNode *node, Node *left, Node *right);
 
-  Node *beta_reduction(LambdaNode *lambda, Node *argument, std::unordered_set<std::string> &bound_vars, std::unordered_set<std::string> &free_vars);
+  void enter(Node *node, bool head_only);
 
-  void find_free_vars(Node *node, std::unordered_set<std::string> &free_vars);
+  void leave();
 };
 
 #endif // INTERPRETER_H
@@ -1,67 +1,416 @@
 #include "parser.h"
 #include "interpreter.h"
+#include "church.h"
+#include "pool.h"
+#include "debruijn.h"
+#include "cek.h"
+#include "need.h"
+#include "vm.h"
+#include "inet.h"
+#include "memo.h"
+#include "workpool.h"
+#include "input.h"
+#include "printer.h"
+#include "termfile.h"
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <string>
-#include <fstream>
+#include <memory>
+#include <sstream>
+#include <vector>
 #include <unordered_set>
 
-int main(int argc, char *argv[]) {
-  if (argc > 3 || argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " [file_name] <-d>" << std::endl;
-    return 1;
+static int usage(const char *program) {
+  std::cerr << "Usage: " << program << " [file_name] <-d> <-m> <-l> <-o max_chars> <-r> <-w term_file> <-e subst|debruijn|cek|need|vm|inet>"
+            << " <-a> <-s cbv|applicative|cbn|normal|hnf|whnf> <-c cache_size> <-n max_iterations> <-p threads> <-j threads> <-t>" << std::endl;
+  return 1;
+}
+
+// Every strategy is its own instantiation of Interpreter, so the strategy is chosen here once per expression
+static Node *interpret(const std::string &strategy, NodePool &pool, Node *root, int &iterations, int limit,
+                       ChurchArithmetic *arithmetic) {
+  if (strategy == "applicative") {
+    return Interpreter<ApplicativeOrder>(pool, limit, arithmetic).eval(root, iterations);
+  } else if (strategy == "cbn") {
+    return Interpreter<CallByName>(pool, limit, arithmetic).eval(root, iterations);
+  } else if (strategy == "normal") {
+    return Interpreter<NormalOrder>(pool, limit, arithmetic).eval(root, iterations);
+  } else if (strategy == "hnf") {
+    return Interpreter<HeadNormalForm>(pool, limit, arithmetic).eval(root, iterations);
+  } else if (strategy == "whnf") {
+    return Interpreter<WeakHeadNormalForm>(pool, limit, arithmetic).eval(root, iterations);
   }
+  return Interpreter<CallByValue>(pool, limit, arithmetic).eval(root, iterations);
+}
 
+// Parser, engines and arena of one thread. A line is parsed and reduced with the instances of the thread
+// that processes it, and its nodes are released when that thread starts on its next line.
+struct Context {
+  NodePool pool;
+  Parser parser;
+  DeBruijnEngine debruijn;
+  CekMachine cek;
+  NeedMachine need;
+  BytecodeMachine vm;
+  InteractionNetEngine inet;
+  ChurchArithmetic arithmetic;
+  Printer printer;
+  TermLoader loader;
+  TermWriter writer;
 
-  std::ifstream inFile(argv[1]);
-  if (!inFile) {
-    std::cerr << "Cannot open input file: " << argv[1] << std::endl;
+  Context(int limit, bool minimal, bool sharing, size_t cap, bool writing, WorkPool *workers)
+      : parser(pool), debruijn(pool, limit, workers, named(sharing, writing, cap)),
+        cek(pool, limit, named(sharing, writing, cap)), need(pool, limit, named(sharing, writing, cap)),
+        vm(pool, limit, named(sharing, writing, cap)), inet(pool, limit, named(sharing, writing, cap)),
+        printer(minimal, sharing, cap) {}
+
+  // Characters of a result whose names the engines keep exactly: what the printer prints of it, unless all
+  // of it is needed for sharing or the term file
+  static size_t named(bool sharing, bool writing, size_t cap) { return sharing || writing ? 0 : cap; }
+};
+
+// Settings from the command line that every line is processed with
+struct Options {
+  bool debugMode = false;
+  bool minimal = false;
+  bool sharing = false;
+  bool binary = false; // The input is a term file (-r)
+  bool arithmetic = false; // Church arithmetic is computed natively (-a)
+  size_t cap = 0; // Characters printed per term, 0 for all
+  std::string engine = "subst";
+  std::string strategy = "cbv";
+  int limit = MAX_ITERATIONS;
+};
+
+// Outcome of one line in batch mode, kept until the lines before it are written
+struct Result {
+  std::string out;
+  std::string err;
+  std::string record;
+  int status = 0;
+  long long iterations = 0;
+  std::chrono::steady_clock::duration time{0};
+};
+
+// Lines read ahead in batch mode; a batch is written once all of its lines are done
+static const size_t BATCH_LINES = 4096;
+
+// Lines of a text file, or with -r the records of a term file, which take the place of the lines
+struct Source {
+  InputFile &file;
+  TermReader *terms;
+
+  bool next(std::string_view &line) { return terms ? terms->next(line) : file.next(line); }
+};
+
+// Parses and reduces one line, writing the results to out and an error to err, and when record is not null,
+// appending the reduced term to it for a term file. Returns the exit status of the program when the line
+// fails and 0 otherwise. The reduction steps and time of the line are added to the totals.
+static int process(std::string_view line, const Options &options, Context &context, MemoCache *memo,
+                   std::ostream &out, std::ostream &err, std::string *record, long long &totalIterations,
+                   std::chrono::steady_clock::duration &reduceTime) {
+  // Release all nodes of the previous line in one go
+  context.pool.reset();
+  // Every line starts with an empty symbol table, so its output is the same on every thread. The memo cache
+  // refers to the symbols of earlier lines and keeps them.
+  if (!memo) {
+    symbols().clear();
+  }
+  Node *root;
+  Node *reduced = nullptr;
+  // Parse the line
+  try {
+    root = options.binary ? context.loader.load(line, context.pool) : context.parser.parse(line);
+    out << "Parsed successfully: ";
+    context.printer.print(root, out);
+    out << '\n';
+    if (options.debugMode) {
+      out << "Dot Tree: \n";
+      context.parser.generate_dot(root, out);
+      out << '\n';
+    }
+  } catch (std::runtime_error &e) {
+    err << "Error: " << e.what() << std::endl;
     return 1;
   }
-  bool debugMode = (argc == 3 && std::string(argv[2]) == "-d");
-
-  std::string line;
-  Parser parser;
-  Interpreter interpreter;
 
-  // Read line by line
-  while (std::getline(inFile, line)) {
-    Node *root;
-    Node *reduced = nullptr;
-    // Parse the line
-    try {
-      root = parser.parse(line);
-      std::cout << "Parsed successfully: " << root->to_string() << std::endl;
-      if (debugMode) {
-        std::cout << "Dot Tree: \n" << parser.generate_dot(root) << std::endl;
+  int iterations = 0;
+  // Evaluate the expression
+  try {
+    auto start = std::chrono::steady_clock::now();
+    if (memo && (reduced = memo->find(root, context.pool))) {
+      // Seen before, up to the names of the bound variables
+    } else if (options.engine == "debruijn") {
+      reduced = context.debruijn.eval(root, iterations);
+    } else if (options.engine == "cek") {
+      reduced = context.cek.eval(root, iterations);
+    } else if (options.engine == "need") {
+      reduced = context.need.eval(root, iterations);
+    } else if (options.engine == "vm") {
+      reduced = context.vm.eval(root, iterations);
+    } else if (options.engine == "inet") {
+      reduced = context.inet.eval(root, iterations);
+    } else {
+      reduced = interpret(options.strategy, context.pool, root, iterations, options.limit,
+                          options.arithmetic ? &context.arithmetic : nullptr);
+    }
+    reduceTime += std::chrono::steady_clock::now() - start;
+    totalIterations += iterations;
+    if (memo && reduced) {
+      memo->insert(reduced);
+    }
+    if (reduced) {
+      out << "Reduced expression: ";
+      context.printer.print(reduced, out);
+      out << '\n';
+      if (record) {
+        context.writer.write(reduced, *record);
       }
-    } catch (std::runtime_error &e) {
-      std::cerr << "Error: " << e.what() << std::endl;
+    } else {
+      out << "Could not reduce the expression further." << '\n';
+    }
+  } catch (DivergenceError &e) {
+    // Proven not to terminate, which is reported like reaching the limit
+    err << "Error: " << e.what() << std::endl;
+    return 2;
+  } catch (std::runtime_error &e) {
+    err << "Error: " << e.what() << std::endl;
+    if (std::string(e.what()) == "Maximum number of iterations reached") {
+      return 2;
+    } else {
       return 1;
     }
+  }
+  return 0;
+}
 
-    int iterations = 0;
-    // Evaluate the expression
-    try {
-      reduced = interpreter.eval(root, iterations);
-      if (reduced) {
-        std::cout << "Reduced expression: " << reduced->to_string() << std::endl;
-      } else {
-        delete reduced;
-        std::cout << "Could not reduce the expression further." << std::endl;
+// Batch mode (-j): the lines of a batch are processed on the threads of a pool, each with a context of its
+// own, and their results are written in input order. Like the sequential loop, it stops at the first line
+// that fails, after writing the lines before it; lines after it are skipped.
+static int batch(Source &in, const Options &options, unsigned jobs, std::ostream *termOut,
+                 long long &totalIterations, std::chrono::steady_clock::duration &reduceTime) {
+  WorkPool workers(jobs);
+  std::vector<std::unique_ptr<Context>> contexts;
+  for (unsigned i = 0; i < workers.size(); ++i) {
+    contexts.emplace_back(new Context(options.limit, options.minimal, options.sharing, options.cap, termOut != nullptr,
+                                      nullptr));
+  }
+  // Views into the mapped input, so a batch is not copied
+  std::vector<std::string_view> lines(BATCH_LINES);
+  std::vector<Result> results;
+  while (true) {
+    size_t count = 0;
+    while (count < BATCH_LINES && in.next(lines[count])) {
+      ++count;
+    }
+    if (count == 0) {
+      return 0;
+    }
+    results.assign(count, Result());
+    // Index of the first line that failed so far
+    std::atomic<size_t> failed(count);
+    workers.run(count, [&](size_t i) {
+      if (i > failed.load()) {
+        return;
+      }
+      Result &result = results[i];
+      std::ostringstream out, err;
+      result.status = process(lines[i], options, *contexts[workers.index()], nullptr, out, err,
+                              termOut ? &result.record : nullptr, result.iterations, result.time);
+      result.out = out.str();
+      result.err = err.str();
+      size_t first = failed.load();
+      while (result.status != 0 && i < first && !failed.compare_exchange_weak(first, i)) {
+      }
+    });
+    for (Result &result : results) {
+      std::cout << result.out;
+      std::cerr << result.err;
+      if (termOut) {
+        termOut->write(result.record.data(), static_cast<std::streamsize>(result.record.size()));
       }
+      totalIterations += result.iterations;
+      reduceTime += result.time;
+      if (result.status != 0) {
+        return result.status;
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    return usage(argv[0]);
+  }
+
+  Options options;
+  bool timing = false;
+  long cacheSize = 0;
+  long maxIterations = MAX_ITERATIONS;
+  long threads = 0;
+  long jobs = 0;
+  const char *termPath = nullptr;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-d") {
+      options.debugMode = true;
+    } else if (arg == "-m") {
+      options.minimal = true;
+    } else if (arg == "-r") {
+      options.binary = true;
+    } else if (arg == "-a") {
+      options.arithmetic = true;
+    } else if (arg == "-w" && i + 1 < argc) {
+      termPath = argv[++i];
+    } else if (arg == "-l") {
+      options.sharing = true;
+    } else if (arg == "-t") {
+      timing = true;
+    } else if (arg == "-e" && i + 1 < argc) {
+      options.engine = argv[++i];
+    } else if (arg == "-s" && i + 1 < argc) {
+      options.strategy = argv[++i];
+    } else if (arg == "-c" && i + 1 < argc) {
+      char *end;
+      cacheSize = std::strtol(argv[++i], &end, 10);
+      if (*end || cacheSize <= 0) {
+        return usage(argv[0]);
+      }
+    } else if ((arg == "-p" || arg == "-j") && i + 1 < argc) {
+      char *end;
+      long &count = arg == "-p" ? threads : jobs;
+      count = std::strtol(argv[++i], &end, 10);
+      if (*end || count <= 0 || count > 1024) {
+        return usage(argv[0]);
+      }
+    } else if (arg == "-o" && i + 1 < argc) {
+      char *end;
+      long long cap = std::strtoll(argv[++i], &end, 10);
+      if (*end || cap <= 0) {
+        return usage(argv[0]);
+      }
+      options.cap = static_cast<size_t>(cap);
+    } else if (arg == "-n" && i + 1 < argc) {
+      char *end;
+      maxIterations = std::strtol(argv[++i], &end, 10);
+      if (*end || maxIterations <= 0 || maxIterations > INT_MAX) {
+        return usage(argv[0]);
+      }
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  const std::string &engine = options.engine;
+  const std::string &strategy = options.strategy;
+  if (engine != "subst" && engine != "debruijn" && engine != "cek" && engine != "need" &&
+      engine != "vm" && engine != "inet") {
+    std::cerr << "Unknown engine: " << engine << std::endl;
+    return usage(argv[0]);
+  }
+  if (strategy != "cbv" && strategy != "applicative" && strategy != "cbn" && strategy != "normal" &&
+      strategy != "hnf" && strategy != "whnf") {
+    std::cerr << "Unknown strategy: " << strategy << std::endl;
+    return usage(argv[0]);
+  }
+  if (strategy != "cbv" && engine != "subst") {
+    std::cerr << "Only the subst engine supports other strategies than cbv" << std::endl;
+    return usage(argv[0]);
+  }
+  if (options.arithmetic && engine != "subst") {
+    std::cerr << "Only the subst engine supports native arithmetic" << std::endl;
+    return usage(argv[0]);
+  }
+  if (threads > 0 && engine != "debruijn") {
+    std::cerr << "Only the debruijn engine supports parallel reduction" << std::endl;
+    return usage(argv[0]);
+  }
+  // The subst engine renames bound variables by name, so alpha-equivalent lines can reduce to terms that differ
+  // in more than their names, and a cached result would not be the answer of the line
+  if (cacheSize > 0 && engine == "subst") {
+    std::cerr << "The memo cache needs an engine that does not depend on names, not subst" << std::endl;
+    return usage(argv[0]);
+  }
+  if (jobs > 0 && (threads > 0 || cacheSize > 0)) {
+    std::cerr << "Batch mode cannot be combined with parallel reduction or the memo cache" << std::endl;
+    return usage(argv[0]);
+  }
+
+  InputFile inFile(argv[1]);
+  if (!inFile.is_open()) {
+    std::cerr << "Cannot open input file: " << argv[1] << std::endl;
+    return 1;
+  }
+  // The records of a term file are views into its mapping, like the lines of a text file
+  std::unique_ptr<TermReader> terms;
+  if (options.binary) {
+    try {
+      terms.reset(new TermReader(inFile.contents()));
     } catch (std::runtime_error &e) {
       std::cerr << "Error: " << e.what() << std::endl;
-      if (std::string(e.what()) == "Maximum number of iterations reached") {
-        return 2;
-      } else {
-        return 1;
-      }
+      return 1;
     }
+  }
+  Source source{inFile, terms.get()};
+  // Reduced terms of -w, written in input order
+  std::ofstream termFile;
+  std::string record;
+  if (termPath) {
+    termFile.open(termPath, std::ios::binary);
+    if (!termFile) {
+      std::cerr << "Cannot open output file: " << termPath << std::endl;
+      return 1;
+    }
+    TermWriter::header(record);
+    termFile.write(record.data(), static_cast<std::streamsize>(record.size()));
+  }
+
+  options.limit = static_cast<int>(maxIterations);
+  // Reduction steps and time spent reducing, over all lines
+  long long totalIterations = 0;
+  std::chrono::steady_clock::duration reduceTime(0);
+  int status = 0;
 
-    delete root;
-    delete reduced;
+  if (jobs > 0) {
+    status = batch(source, options, static_cast<unsigned>(jobs), termPath ? &termFile : nullptr, totalIterations,
+                   reduceTime);
+  } else {
+    // Threads for the parallel reduction of -p; the main thread is one of them
+    WorkPool workers(static_cast<unsigned>(threads));
+    Context context(options.limit, options.minimal, options.sharing, options.cap, termPath != nullptr,
+                    threads > 0 ? &workers : nullptr);
+    // Normal forms of earlier lines, shared by all lines when enabled with -c
+    MemoCache memo(cacheSize);
+
+    // Read line by line
+    std::string_view line;
+    while (status == 0 && source.next(line)) {
+      record.clear();
+      status = process(line, options, context, cacheSize > 0 ? &memo : nullptr, std::cout, std::cerr,
+                       termPath ? &record : nullptr, totalIterations, reduceTime);
+      if (termPath) {
+        termFile.write(record.data(), static_cast<std::streamsize>(record.size()));
+      }
+    }
+    if (status == 0 && cacheSize > 0) {
+      std::cerr << "Memo cache: " << memo.hits() << " hits, " << memo.misses() << " misses" << std::endl;
+    }
+  }
+  if (termPath && !termFile.flush()) {
+    std::cerr << "Cannot write output file: " << termPath << std::endl;
+    return 1;
+  }
+  if (status != 0) {
+    return status;
   }
 
+  if (timing) {
+    double seconds = std::chrono::duration<double>(reduceTime).count();
+    std::cerr << "Reduction: " << totalIterations << " steps in " << seconds * 1000 << " ms, "
+              << static_cast<long long>(seconds > 0 ? totalIterations / seconds : 0) << " steps per second" << std::endl;
+  }
   return 0;
 }
-
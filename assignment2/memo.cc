@@ -0,0 +1,159 @@
+// memo.cc
+#include "memo.h"
+
+// Tag of a bound variable in a key and of a repeated node in a normal form; the other words are tagged
+// with their NodeKind
+static const uint32_t BOUND = 3;
+static const uint32_t REPEAT = 3;
+
+static uint32_t word(NodeKind kind, uint32_t value) {
+  return value << 2 | static_cast<uint32_t>(kind);
+}
+
+Node *MemoCache::find(Node *node, NodePool &pool) {
+  encode_key(node);
+  size_t hash = probe.key.size();
+  for (uint32_t w : probe.key) {
+    hash = hash_combine(hash, w);
+  }
+  probe.hash = hash;
+
+  auto found = index.find(&probe);
+  if (found == index.end()) {
+    miss_count++;
+    return nullptr;
+  }
+  hit_count++;
+  entries.splice(entries.begin(), entries, found->second);
+  return decode(found->second->normal, pool);
+}
+
+void MemoCache::insert(Node *reduced) {
+  if (capacity == 0 || index.count(&probe)) {
+    return;
+  }
+  entries.push_front(Entry{probe.key, probe.hash, Code()});
+  encode(reduced, entries.front().normal);
+  index[&entries.front()] = entries.begin();
+  if (entries.size() > capacity) {
+    index.erase(&entries.back());
+    entries.pop_back();
+  }
+}
+
+void MemoCache::encode_key(Node *node) {
+  // A bound variable is replaced by the number of binders between it and its own, and a parameter by
+  // nothing, so the key does not depend on the names of bound variables. The second half of a pair marks
+  // a lambda whose body is done, so its parameter goes out of scope.
+  probe.key.clear();
+  pending.clear();
+  if (scopes.size() < symbols().size()) {
+    scopes.resize(symbols().size());
+  }
+  uint32_t depth = 0;
+  pending.push_back({node, false});
+  while (!pending.empty()) {
+    std::pair<Node *, bool> top = pending.back();
+    pending.pop_back();
+    Node *current = top.first;
+    if (top.second) {
+      scopes[static_cast<LambdaNode *>(current)->param].pop_back();
+      depth--;
+      continue;
+    }
+    switch (current->kind) {
+      case NodeKind::Variable: {
+        Symbol name = static_cast<VariableNode *>(current)->name;
+        if (scopes[name].empty()) {
+          probe.key.push_back(word(NodeKind::Variable, name));
+        } else {
+          probe.key.push_back((depth - 1 - scopes[name].back()) << 2 | BOUND);
+        }
+        break;
+      }
+      case NodeKind::Lambda: {
+        auto l = static_cast<LambdaNode *>(current);
+        probe.key.push_back(word(NodeKind::Lambda, 0));
+        scopes[l->param].push_back(depth++);
+        pending.push_back({current, true});
+        pending.push_back({l->body, false});
+        break;
+      }
+      case NodeKind::Application: {
+        auto a = static_cast<ApplicationNode *>(current);
+        probe.key.push_back(word(NodeKind::Application, 0));
+        pending.push_back({a->right, false});
+        pending.push_back({a->left, false});
+        break;
+      }
+    }
+  }
+}
+
+void MemoCache::encode(Node *node, Code &code) {
+  // Post-order, so a node is numbered once its children are written. The second half of a pair marks a
+  // node whose children are done.
+  numbers.clear();
+  pending.clear();
+  pending.push_back({node, false});
+  while (!pending.empty()) {
+    std::pair<Node *, bool> top = pending.back();
+    pending.pop_back();
+    Node *current = top.first;
+    if (!top.second) {
+      auto found = numbers.find(current);
+      if (found != numbers.end()) {
+        code.push_back(found->second << 2 | REPEAT);
+        continue;
+      }
+      if (current->kind == NodeKind::Variable) {
+        code.push_back(word(NodeKind::Variable, static_cast<VariableNode *>(current)->name));
+        numbers.emplace(current, static_cast<uint32_t>(numbers.size()));
+        continue;
+      }
+      pending.push_back({current, true});
+      if (current->kind == NodeKind::Lambda) {
+        pending.push_back({static_cast<LambdaNode *>(current)->body, false});
+      } else {
+        pending.push_back({static_cast<ApplicationNode *>(current)->right, false});
+        pending.push_back({static_cast<ApplicationNode *>(current)->left, false});
+      }
+      continue;
+    }
+    if (current->kind == NodeKind::Lambda) {
+      code.push_back(word(NodeKind::Lambda, static_cast<LambdaNode *>(current)->param));
+    } else {
+      code.push_back(word(NodeKind::Application, 0));
+    }
+    numbers.emplace(current, static_cast<uint32_t>(numbers.size()));
+  }
+}
+
+Node *MemoCache::decode(const Code &code, NodePool &pool) {
+  // In post-order the children of a node are on top of the stack when it is reached, the argument above
+  // the function
+  built.clear();
+  decoded.clear();
+  for (uint32_t w : code) {
+    if ((w & 3) == REPEAT) {
+      built.push_back(decoded[w >> 2]);
+      continue;
+    }
+    switch (static_cast<NodeKind>(w & 3)) {
+      case NodeKind::Variable:
+        built.push_back(pool.variable(w >> 2));
+        break;
+      case NodeKind::Lambda:
+        built.back() = pool.lambda(w >> 2, built.back());
+        break;
+      case NodeKind::Application: {
+        Node *right = built.back();
+        built.pop_back();
+        built.back() = pool.application(built.back(), right);
+        break;
+      }
+    }
+    decoded.push_back(built.back());
+  }
+  return built.back();
+}
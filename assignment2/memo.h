@@ -0,0 +1,74 @@
+// memo.h
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "parser.h"
+#include "pool.h"
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// Bounded LRU cache from expressions to their normal forms, kept across input lines. Expressions are
+// looked up by their de Bruijn form, so two expressions that only differ in the names of their bound
+// variables share an entry. Entries are stored as flat code instead of nodes, since the pool is reset
+// for every line; a hit rebuilds the cached normal form with the names it was first computed with.
+class MemoCache {
+public:
+  explicit MemoCache(size_t capacity) : capacity(capacity) {}
+
+  // Returns the cached normal form of node, built in pool, or null when it is not cached
+  Node *find(Node *node, NodePool &pool);
+
+  // Remembers the normal form of the expression given to the last find, evicting the least recently used
+  // entry when the cache is full
+  void insert(Node *reduced);
+
+  size_t hits() const { return hit_count; }
+
+  size_t misses() const { return miss_count; }
+
+private:
+  // A node is encoded as one word per node: the kind in the low two bits and the symbol (variable,
+  // parameter) or de Bruijn index (bound variable in a key) above them. A key is in pre-order. A normal form
+  // is in post-order, and a node that occurs again is one word with the number of the node it repeats, so
+  // a result that shares its subterms is stored in the size of its graph rather than of its tree.
+  typedef std::vector<uint32_t> Code;
+
+  struct Entry {
+    Code key;    // De Bruijn form of the expression, without the parameter names
+    size_t hash; // Hash of key, so it is invariant under renaming bound variables
+    Code normal; // Normal form with its names
+  };
+
+  struct KeyHash {
+    size_t operator()(const Entry *entry) const { return entry->hash; }
+  };
+
+  struct KeyEqual {
+    bool operator()(const Entry *a, const Entry *b) const { return a->key == b->key; }
+  };
+
+  size_t capacity;
+  size_t hit_count = 0;
+  size_t miss_count = 0;
+  std::list<Entry> entries; // Most recently used first
+  std::unordered_map<const Entry *, std::list<Entry>::iterator, KeyHash, KeyEqual> index;
+  Entry probe; // Key of the last find
+  // Work stacks of the encoding and decoding, kept between calls so their capacity is reused
+  std::vector<std::pair<Node *, bool>> pending;
+  std::vector<Node *> built;
+  // Numbers of the nodes of the normal form being encoded, and the nodes of the one being decoded by number
+  std::unordered_map<Node *, uint32_t> numbers;
+  std::vector<Node *> decoded;
+  // Depths of the enclosing binders of every name, indexed by symbol
+  std::vector<std::vector<uint32_t>> scopes;
+
+  void encode_key(Node *node);
+
+  void encode(Node *node, Code &code);
+
+  Node *decode(const Code &code, NodePool &pool);
+};
+
+#endif //MEMO_H
@@ -0,0 +1,206 @@
+// need.cc
+#include "need.h"
+#include "interpreter.h"
+
+Node *NeedMachine::eval(Node *node, int &iterations) {
+  // The thunks and terms of the previous expression are no longer needed
+  arena.reset();
+  terms.reset();
+  quoted.clear();
+  stack.clear();
+  started.clear();
+  active.clear();
+  std::vector<Symbol> binders;
+  NeedValue *value = run(terms.from_node(node, binders), nullptr, 0, iterations);
+  return terms.to_node(readback(value, iterations));
+}
+
+bool NeedMachine::StartEqual::operator()(const Start &a, const Start &b) const {
+  // A thunk stands for the same term whether or not it was evaluated, so environments match when they
+  // hold the same thunks
+  if (a.control != b.control) {
+    return false;
+  }
+  const NeedEnv *x = a.env, *y = b.env;
+  for (; x != y; x = x->next, y = y->next) {
+    if (!x || !y || x->thunk != y->thunk) {
+      return false;
+    }
+  }
+  return true;
+}
+
+NeedValue *NeedMachine::make_value(NeedValue::Kind kind) {
+  return arena.make<NeedValue>(NeedValue{kind, NO_SYMBOL, nullptr, nullptr, nullptr, nullptr});
+}
+
+NeedValue *NeedMachine::force(Thunk *thunk, int &iterations) {
+  if (!thunk->value) {
+    size_t base = stack.size();
+    stack.push_back({Frame::Update, thunk});
+    run(thunk->term, thunk->env, base, iterations);
+  }
+  return thunk->value;
+}
+
+NeedValue *NeedMachine::run(DBTerm *control, NeedEnv *env, size_t base, int &iterations) {
+  // Runs until the stack is back at base, so a thunk can be forced while printing
+  NeedValue *value = nullptr;
+
+  while (true) {
+    if (control) {
+      if (iterations >= max_iterations) {
+        throw std::runtime_error("Maximum number of iterations reached");
+      }
+      iterations++;
+
+      if (control->kind == DBTerm::Bound) {
+        NeedEnv *entry = env;
+        for (uint32_t i = 0; i < control->value; ++i) {
+          entry = entry->next;
+        }
+        Thunk *thunk = entry->thunk;
+        if (thunk->value) {
+          value = thunk->value;
+          control = nullptr;
+        } else {
+          // First use of the argument: evaluate it and remember to update the thunk
+          stack.push_back({Frame::Update, thunk});
+          control = thunk->term;
+          env = thunk->env;
+        }
+      } else if (control->kind == DBTerm::Free) {
+        value = make_value(NeedValue::Free);
+        value->name = control->value;
+        control = nullptr;
+      } else if (control->kind == DBTerm::Lambda) {
+        value = make_value(NeedValue::Closure);
+        value->lambda = control;
+        value->env = env;
+        control = nullptr;
+      } else {
+        // Delay the argument; a variable already refers to a thunk that can be shared as is
+        DBTerm *arg = control->right;
+        Thunk *thunk;
+        if (arg->kind == DBTerm::Bound) {
+          NeedEnv *entry = env;
+          for (uint32_t i = 0; i < arg->value; ++i) {
+            entry = entry->next;
+          }
+          thunk = entry->thunk;
+        } else {
+          thunk = arena.make<Thunk>(Thunk{arg, env, nullptr});
+        }
+        stack.push_back({Frame::Argument, thunk});
+        control = control->left;
+      }
+    } else {
+      // The value is passed to the top frame, or returned, so every call started above it is done
+      while (!started.empty() && started.back().depth >= stack.size()) {
+        active.erase(started.back());
+        started.pop_back();
+      }
+      if (stack.size() == base) {
+        return value;
+      }
+      Frame frame = stack.back();
+      stack.pop_back();
+
+      if (frame.kind == Frame::Update) {
+        // Write the result back in place, so the argument is never evaluated again
+        frame.thunk->value = value;
+        frame.thunk->term = nullptr;
+        frame.thunk->env = nullptr;
+      } else if (value->kind == NeedValue::Closure) {
+        size_t hash = hash_combine(std::hash<Thunk *>()(frame.thunk), value->env ? value->env->hash : 0);
+        env = arena.make<NeedEnv>(NeedEnv{frame.thunk, value->env, hash});
+        control = value->lambda->left;
+        // Reaching the same body with the same thunks again within the call proves it never returns
+        Start start = {control, env, stack.size()};
+        if (!active.insert(start).second) {
+          throw DivergenceError("Expression does not terminate: the reduction returned to an earlier state");
+        }
+        started.push_back(start);
+      } else {
+        NeedValue *stuck = make_value(NeedValue::Stuck);
+        stuck->fn = value;
+        stuck->arg = frame.thunk;
+        value = stuck;
+      }
+    }
+  }
+}
+
+DBTerm *NeedMachine::readback(NeedValue *value, int &iterations) {
+  // Runs on the task stack, so neither deep values nor deep terms can overflow the native stack
+  tasks.clear();
+  built.clear();
+  tasks.push_back({Task::Value, value, nullptr, nullptr, nullptr, 0});
+  while (!tasks.empty()) {
+    Task task = tasks.back();
+    tasks.pop_back();
+    switch (task.kind) {
+      case Task::Thunk:
+        tasks.push_back({Task::Value, force(task.thunk, iterations), nullptr, nullptr, nullptr, 0});
+        break;
+      case Task::Value: {
+        auto found = quoted.find(task.value);
+        if (found != quoted.end()) {
+          built.push_back(found->second);
+        } else if (task.value->kind == NeedValue::Free) {
+          DBTerm *term = terms.make(DBTerm::Free, task.value->name, nullptr, nullptr);
+          quoted[task.value] = term;
+          built.push_back(term);
+        } else if (task.value->kind == NeedValue::Stuck) {
+          // The argument is forced only after the function has been read back
+          tasks.push_back({Task::Stuck, task.value, nullptr, nullptr, nullptr, 0});
+          tasks.push_back({Task::Thunk, nullptr, task.value->arg, nullptr, nullptr, 0});
+          tasks.push_back({Task::Value, task.value->fn, nullptr, nullptr, nullptr, 0});
+        } else {
+          tasks.push_back({Task::Closure, task.value, nullptr, nullptr, nullptr, 0});
+          tasks.push_back({Task::Term, nullptr, nullptr, task.value->lambda->left, task.value->env, 1});
+        }
+        break;
+      }
+      case Task::Term: {
+        // Only thunks that the body actually refers to are evaluated
+        DBTerm *term = task.term;
+        if (term->loose <= task.depth) {
+          built.push_back(term);
+        } else if (term->kind == DBTerm::Bound) {
+          NeedEnv *entry = task.env;
+          for (uint32_t i = task.depth; i < term->value; ++i) {
+            entry = entry->next;
+          }
+          tasks.push_back({Task::Thunk, nullptr, entry->thunk, nullptr, nullptr, 0});
+        } else if (term->kind == DBTerm::Lambda) {
+          tasks.push_back({Task::Lambda, nullptr, nullptr, term, nullptr, 0});
+          tasks.push_back({Task::Term, nullptr, nullptr, term->left, task.env, task.depth + 1});
+        } else {
+          tasks.push_back({Task::Application, nullptr, nullptr, nullptr, nullptr, 0});
+          tasks.push_back({Task::Term, nullptr, nullptr, term->right, task.env, task.depth});
+          tasks.push_back({Task::Term, nullptr, nullptr, term->left, task.env, task.depth});
+        }
+        break;
+      }
+      case Task::Closure:
+        built.back() = terms.make(DBTerm::Lambda, task.value->lambda->value, built.back(), nullptr);
+        quoted[task.value] = built.back();
+        break;
+      case Task::Lambda:
+        built.back() = terms.make(DBTerm::Lambda, task.term->value, built.back(), nullptr);
+        break;
+      case Task::Stuck:
+      case Task::Application: {
+        DBTerm *right = built.back();
+        built.pop_back();
+        built.back() = terms.make(DBTerm::Application, 0, built.back(), right);
+        if (task.kind == Task::Stuck) {
+          quoted[task.value] = built.back();
+        }
+        break;
+      }
+    }
+  }
+  return built.back();
+}
@@ -0,0 +1,119 @@
+// need.h
+#ifndef NEED_H
+#define NEED_H
+
+#include "parser.h"
+#include "pool.h"
+#include "arena.h"
+#include "debruijn.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct NeedValue;
+struct NeedEnv;
+
+// Suspended argument. It is evaluated the first time it is needed, after which the value is written back
+// into the thunk so every other use of the argument shares the result.
+struct Thunk {
+  DBTerm *term;    // Null once evaluated
+  NeedEnv *env;
+  NeedValue *value;
+};
+
+struct NeedValue {
+  enum Kind : uint8_t {
+    Closure, Free, Stuck
+  };
+
+  Kind kind;
+  Symbol name;     // Free: the variable
+  DBTerm *lambda;  // Closure: the lambda term
+  NeedEnv *env;    // Closure: thunks of the variables the lambda refers to
+  NeedValue *fn;   // Stuck: the function part
+  Thunk *arg;      // Stuck: the argument, which is only evaluated for printing
+};
+
+struct NeedEnv {
+  Thunk *thunk;
+  NeedEnv *next;
+  size_t hash; // Hash of the thunk pointers
+};
+
+// Call-by-need (lazy) machine. Arguments are not evaluated before a beta step but passed as shared thunks,
+// so an argument that is never used is never reduced and one that is used many times is reduced once.
+// Reduces the expression to weak head normal form; the readback phase then evaluates the arguments of
+// stuck applications and the variables used in lambda bodies, like the other engines do.
+class NeedMachine {
+public:
+  // cap is passed on to the conversion of the result, see DeBruijnEngine
+  NeedMachine(NodePool &pool, int max_iterations = MAX_ITERATIONS, size_t cap = 0)
+      : terms(pool, MAX_ITERATIONS, nullptr, cap), max_iterations(max_iterations) {}
+
+  Node *eval(Node *node, int &iterations);
+
+private:
+  struct Frame {
+    enum Kind : uint8_t {
+      Argument, // Apply the value to this thunk
+      Update    // Write the value back into this thunk
+    };
+
+    Kind kind;
+    Thunk *thunk;
+  };
+
+  // Control and environment of the body after a beta step, which continues the call that reduced the
+  // application at stack depth
+  struct Start {
+    DBTerm *control;
+    NeedEnv *env;
+    size_t depth;
+  };
+
+  struct StartHash {
+    size_t operator()(const Start &start) const {
+      return hash_combine(start.control->hash, start.env ? start.env->hash : 0);
+    }
+  };
+
+  struct StartEqual {
+    bool operator()(const Start &a, const Start &b) const;
+  };
+
+  // Pending step of the readback: quote a value, a thunk (forcing it first) or a term under env, or build
+  // a term from the results of the steps before it
+  struct Task {
+    enum Kind : uint8_t {
+      Value, Thunk, Term, Closure, Stuck, Lambda, Application
+    };
+
+    Kind kind;
+    NeedValue *value; // Value, Closure, Stuck
+    ::Thunk *thunk;   // Thunk
+    DBTerm *term;     // Term, Lambda
+    NeedEnv *env;     // Term
+    uint32_t depth;   // Term: number of lambdas of the term entered so far
+  };
+
+  DeBruijnEngine terms; // Converts between nodes and de Bruijn terms
+  int max_iterations;
+  Arena arena;          // Holds the thunks, values and environments of the expression being evaluated
+  std::vector<Frame> stack;
+  // Beta steps of the calls in progress, in the order they were started
+  std::vector<Start> started;
+  std::unordered_set<Start, StartHash, StartEqual> active;
+  std::vector<Task> tasks;
+  std::vector<DBTerm *> built;
+  std::unordered_map<NeedValue *, DBTerm *> quoted;
+
+  NeedValue *make_value(NeedValue::Kind kind);
+
+  NeedValue *force(Thunk *thunk, int &iterations);
+
+  NeedValue *run(DBTerm *control, NeedEnv *env, size_t base, int &iterations);
+
+  DBTerm *readback(NeedValue *value, int &iterations);
+};
+
+#endif //NEED_H
@@ -1,33 +1,26 @@
 // parser.cc
 #include "parser.h"
-#include <sstream>
+#include "pool.h"
+#include "printer.h"
 
-VariableNode::VariableNode(const std::string &name) : name(name) {}
-
-std::string VariableNode::to_string() const {
-  return name;
-}
-
-LambdaNode::LambdaNode(const std::string &param, Node *body) : param(param), body(body) { /*...*/ }
-
-std::string LambdaNode::to_string() const {
-  return "\\" + param + " (" + body->to_string() + ")";
+std::string Node::to_string() const {
+  std::string out;
+  Printer().print(this, out);
+  return out;
 }
 
-LambdaNode::~LambdaNode() {
-  delete body;
-}
-
-ApplicationNode::ApplicationNode(Node *left, Node *right) : left(left), right(right) {}
+VariableNode::VariableNode(Symbol name)
+    : Node(NodeKind::Variable, hash_combine(1, name), 1, symbol_bit(name), 0), name(name) {}
 
-std::string ApplicationNode::to_string() const {
-  return "(" + left->to_string() + " " + right->to_string() + ")";
-}
+LambdaNode::LambdaNode(Symbol param, Node *body)
+    : Node(NodeKind::Lambda, hash_combine(hash_combine(2, param), body->hash),
+           static_cast<uint32_t>(hash_combine(2, body->shape)), body->vars, body->binders | symbol_bit(param)),
+      param(param), body(body) {}
 
-ApplicationNode::~ApplicationNode() {
-  delete left;
-  delete right;
-}
+ApplicationNode::ApplicationNode(Node *left, Node *right)
+    : Node(NodeKind::Application, hash_combine(hash_combine(3, left->hash), right->hash),
+           static_cast<uint32_t>(hash_combine(hash_combine(3, left->shape), right->shape)), left->vars | right->vars,
+           left->binders | right->binders), left(left), right(right) {}
 
 char Parser::current_char() {
   return pos < input.size() ? input[pos] : '\0';
@@ -51,82 +44,89 @@ bool is_open_bracket(wchar_t ch) {
   return ch == '(';
 }
 
-std::string Parser::parse_variable() {
+Symbol Parser::parse_variable() {
   // ⟨var⟩ ::= ⟨alphanum⟩ | ⟨var⟩ ⟨alphanum⟩
   skip_whitespace();
-  std::string var;
+  size_t start = pos;
   if (pos < input.size() && std::isalpha(input[pos])) {
-    var += input[pos];
     ++pos;
   } else {
     throw std::runtime_error("Variable must start with an alphabetic character");
   }
 
   while (pos < input.size() && (std::isalpha(input[pos]) || std::isdigit(input[pos]))) {
-    var += input[pos];
     ++pos;
   }
-  return var;
+  // Interned straight from the input, which only allocates for a name not seen before
+  return symbols().intern(input.substr(start, pos - start));
 }
 
 Node *Parser::parse_expression() {
   // ⟨expr⟩ ::= ⟨var⟩ | '(' ⟨expr⟩ ')' | '\' ⟨var⟩ ⟨expr⟩ | ⟨expr⟩ ⟨expr⟩
-  skip_whitespace();
-
-  Node *expr = parse_atom();
+  frames.clear();
+  frames.push_back({Frame::Group, NO_SYMBOL, nullptr});
 
   while (true) {
-    skip_whitespace();
-    // Check if the current character is the start of a new atom
-    if (current_char() == '(' || std::isalpha(current_char())) {
-      Node *right = parse_atom();
-      expr = new ApplicationNode(expr, right);
-    } else {
-      break; // No more applications, exit loop
+    Node *atom = parse_atom();
+    if (!atom) {
+      continue; // Opened a lambda or a bracket, its contents start with another atom
     }
-  }
 
-  return expr;
+    while (true) {
+      // The atom is the body of the lambdas waiting for one
+      while (frames.back().kind == Frame::Lambda) {
+        atom = pool.lambda(frames.back().param, atom);
+        frames.pop_back();
+      }
+      Frame &group = frames.back();
+      group.expr = group.expr ? pool.application(group.expr, atom) : atom;
+
+      skip_whitespace();
+      // Check if the current character is the start of a new atom
+      if (current_char() == '(' || std::isalpha(current_char())) {
+        break;
+      }
+      if (frames.size() == 1) {
+        return group.expr; // No more applications at the top level
+      }
+      if (current_char() != ')') {
+        throw std::runtime_error("Expected ')'");
+      }
+      ++pos; // consume ')'
+      // the expression inside the brackets is treated as one atom
+      atom = group.expr;
+      frames.pop_back();
+    }
+  }
 }
 
 Node *Parser::parse_atom() {
   // ⟨atom⟩ ::= ⟨var⟩ | '(' ⟨expr⟩ ')' | '\' ⟨var⟩ ⟨expr⟩
+  // Returns a variable, or null after opening a lambda or a bracket on the frame stack
   skip_whitespace();
   wchar_t ch = current_char();
 
   if (is_lambda_char(ch)) {
-    return parse_lambda();
-  } else if (is_open_bracket(ch)) {
-    ++pos; // consume '('
-    Node *node = parse_expression(); // parse expression within the brackets
+    ++pos; // Skip the '\' character
+    Symbol param = parse_variable(); // Parse the parameter name
     skip_whitespace();
-    if (current_char() == ')') {
-      ++pos; // consume ')'
-    } else {
-      throw std::runtime_error("Expected ')'");
+    if (current_char() == '.') {
+      ++pos; // Skip the '.' character
     }
-    return node; // the expression inside the brackets is treated as one atom
+    frames.push_back({Frame::Lambda, param, nullptr}); // The next atom is the body of the lambda
+    return nullptr;
+  } else if (is_open_bracket(ch)) {
+    ++pos; // consume '('
+    frames.push_back({Frame::Group, NO_SYMBOL, nullptr});
+    return nullptr;
   } else if (is_variable_start_char(ch)) {
-    return new VariableNode{parse_variable()};
+    return pool.variable(parse_variable());
   } else {
     throw std::runtime_error("Unexpected character encountered");
   }
 }
 
-
-Node *Parser::parse_lambda() {
-  // ⟨lambda⟩ ::= '\' ⟨var⟩ ⟨expr⟩
-  ++pos; // Skip the '\' character
-  std::string param = parse_variable(); // Parse the parameter name
-  skip_whitespace();
-  if (current_char() == '.') {
-    ++pos; // Skip the '.' character
-  }
-  Node *body = parse_atom(); // Parse the body of the lambda
-  return new LambdaNode{param, body};
-}
-
-Node *Parser::parse(const std::string &input_str) {
+Node *Parser::parse(std::string_view input_str) {
   input = input_str;
   pos = 0;
   Node *result = parse_expression();
@@ -139,32 +139,68 @@ Node *Parser::parse(const std::string &input_str) {
   return result;
 }
 
-std::string Parser::generate_dot(Node *node) {
-  static int counter = 0;
-  std::ostringstream out;
-
-  if (!node) return "";
-  int cur_id = counter++;
-  std::string label;
-
-  if (auto v = dynamic_cast<VariableNode *>(node)) {
-    label = "Variable: " + v->name;
-  } else if (auto l = dynamic_cast<LambdaNode *>(node)) {
-    label = "Lambda: " + l->param;
-    int body_id = counter;
-    out << generate_dot(l->body);
-    out << cur_id << " -> " << body_id << ";\n";
-  } else if (auto a = dynamic_cast<ApplicationNode *>(node)) {
-    label = "Application";
-    int left_id = counter;
-    out << generate_dot(a->left);
-    out << cur_id << " -> " << left_id << ";\n";
-
-    int right_id = counter;
-    out << generate_dot(a->right);
-    out << cur_id << " -> " << right_id << ";\n";
+// Text of a graph collected before it is written to the stream
+static const size_t DOT_CHUNK_SIZE = 1 << 16;
+
+void Parser::generate_dot(const Node *node, std::ostream &out) {
+  // A node still to visit and the id of its parent, or with label set, a visited node whose label is next
+  struct Step {
+    const Node *node;
+    int id;
+    bool label;
+  };
+  std::unordered_map<const Node *, int> ids;
+  std::vector<Step> steps;
+  // Text collected before it is written to out
+  std::string text;
+  steps.push_back({node, -1, false});
+  while (!steps.empty()) {
+    if (text.size() >= DOT_CHUNK_SIZE) {
+      out.write(text.data(), static_cast<std::streamsize>(text.size()));
+      text.clear();
+    }
+    Step step = steps.back();
+    steps.pop_back();
+    if (step.label) {
+      text += std::to_string(step.id);
+      text += " [label=\"";
+      switch (step.node->kind) {
+        case NodeKind::Variable:
+          text += "Variable: ";
+          text += symbols().name(static_cast<const VariableNode *>(step.node)->name);
+          break;
+        case NodeKind::Lambda:
+          text += "Lambda: ";
+          text += symbols().name(static_cast<const LambdaNode *>(step.node)->param);
+          break;
+        case NodeKind::Application:
+          text += "Application";
+          break;
+      }
+      text += "\"];\n";
+      continue;
+    }
+    // Numbered per graph, so the graph of a line does not depend on the lines before it
+    auto inserted = ids.emplace(step.node, static_cast<int>(ids.size()));
+    int id = inserted.first->second;
+    if (step.id != -1) {
+      text += std::to_string(step.id);
+      text += " -> ";
+      text += std::to_string(id);
+      text += ";\n";
+    }
+    // A shared subterm is written once, later parents only draw an edge to it
+    if (!inserted.second) {
+      continue;
+    }
+    steps.push_back({step.node, id, true});
+    if (step.node->kind == NodeKind::Lambda) {
+      steps.push_back({static_cast<const LambdaNode *>(step.node)->body, id, false});
+    } else if (step.node->kind == NodeKind::Application) {
+      auto a = static_cast<const ApplicationNode *>(step.node);
+      steps.push_back({a->right, id, false});
+      steps.push_back({a->left, id, false});
+    }
   }
-
-  out << cur_id << " [label=\"" << label << "\"];\n";
-  return out.str();
+  out.write(text.data(), static_cast<std::streamsize>(text.size()));
 }
@@ -3,87 +3,117 @@
 #define PARSER_H
 
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <vector>
 #include <cctype>
+#include <unordered_map>
+#include <cstdint>
+#include "symbol.h"
 
-class Node {
-public:
-  virtual std::string to_string() const = 0;
+class NodePool;
+
+// Tag of the concrete node class. Traversals switch on it instead of using dynamic_cast,
+// so nodes need no vtable.
+enum class NodeKind : uint8_t {
+  Variable, Lambda, Application
+};
+
+// Bit of a symbol in the variable summaries of a node, which are 64-bit Bloom filters over symbol ids:
+// a clear bit proves that no symbol with that bit is in the set.
+inline uint64_t symbol_bit(Symbol symbol) {
+  return 1ULL << (symbol & 63);
+}
 
-  virtual Node *copy() const = 0;
+inline size_t hash_combine(size_t seed, size_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
 
-  virtual ~Node() = default;
+// Nodes are immutable and hash-consed by NodePool: structurally identical subterms are the same
+// node, so a term is a DAG and sharing a subterm is just sharing the pointer.
+class Node {
+public:
+  const NodeKind kind;
+  // Hash of the node with all names left out, so alpha-equivalent nodes have the same shape
+  const uint32_t shape;
+  const size_t hash;
+  // Summaries computed at construction, so the interpreter can skip subterms without visiting them
+  const uint64_t vars;    // Names of the variables occurring in the node
+  const uint64_t binders; // Parameters of the lambdas in the node
+
+  // Text in the default format of Printer, which prints without recursing
+  std::string to_string() const;
+
+protected:
+  Node(NodeKind kind, size_t hash, uint32_t shape, uint64_t vars, uint64_t binders)
+      : kind(kind), shape(shape), hash(hash), vars(vars), binders(binders) {}
+
+  // Nodes live in an Arena and are never deleted through a Node pointer
+  ~Node() = default;
 };
 
 class VariableNode : public Node {
 public:
-  std::string name;
-
-  VariableNode(const std::string &name);
-
-  std::string to_string() const override;
+  const Symbol name;
 
-  Node *copy() const override {
-    return new VariableNode(*this);
-  }
+  VariableNode(Symbol name);
 };
 
 class LambdaNode : public Node {
 public:
-  std::string param;
-  Node *body;
+  const Symbol param;
+  Node *const body;
 
-  LambdaNode(const std::string &param, Node *body);
-
-  std::string to_string() const override;
-
-  Node *copy() const override {
-    return new LambdaNode(param, body->copy());
-  }
-
-  ~LambdaNode();
+  LambdaNode(Symbol param, Node *body);
 };
 
 class ApplicationNode : public Node {
 public:
-  Node *left;
-  Node *right;
+  Node *const left;
+  Node *const right;
 
   ApplicationNode(Node *left, Node *right);
-
-  std::string to_string() const override;
-
-  Node *copy() const override {
-    return new ApplicationNode(left->copy(), right->copy());
-  }
-
-  ~ApplicationNode();
 };
 
 
 class Parser {
 public:
-  Node *parse(const std::string &input_str);
+  explicit Parser(NodePool &pool) : pool(pool) {}
+
+  // Parses one line. No node refers to input, so it only has to stay valid during the call.
+  Node *parse(std::string_view input_str);
 
-  std::string generate_dot(Node *node);
+  // Writes the nodes and edges of the graph of node to out, in one pass with an explicit stack. A shared
+  // subterm is written once and every parent draws an edge to it. Ids are numbered per call from 0.
+  void generate_dot(const Node *node, std::ostream &out);
 
 private:
-  std::string input;
+  // Construct that is still open while parsing: the top level or a parenthesized expression (Group), or a
+  // lambda waiting for its body. The parser keeps them on a heap stack instead of recursing per nesting level.
+  struct Frame {
+    enum Kind : uint8_t {
+      Group, Lambda
+    };
+
+    Kind kind;
+    Symbol param; // Lambda: the parameter
+    Node *expr;   // Group: the applications parsed so far, null before the first atom
+  };
+
+  NodePool &pool;
+  std::string_view input;
   size_t pos = 0;
+  std::vector<Frame> frames;
 
   char current_char();
 
   void skip_whitespace();
 
-  std::string parse_variable();
+  Symbol parse_variable();
 
   Node *parse_expression();
 
   Node *parse_atom();
-
-  Node *parse_lambda();
-
 };
 
 
@@ -0,0 +1,56 @@
+// pool.cc
+#include "pool.h"
+
+bool NodePool::NodeEqual::operator()(const Node *a, const Node *b) const {
+  // Children are already unique, so a shallow comparison is enough
+  if (a->hash != b->hash || a->kind != b->kind) return false;
+  switch (a->kind) {
+    case NodeKind::Variable:
+      return static_cast<const VariableNode *>(a)->name == static_cast<const VariableNode *>(b)->name;
+    case NodeKind::Lambda: {
+      auto la = static_cast<const LambdaNode *>(a), lb = static_cast<const LambdaNode *>(b);
+      return la->body == lb->body && la->param == lb->param;
+    }
+    case NodeKind::Application: {
+      auto aa = static_cast<const ApplicationNode *>(a), ab = static_cast<const ApplicationNode *>(b);
+      return aa->left == ab->left && aa->right == ab->right;
+    }
+  }
+  return false;
+}
+
+template<typename T>
+Node *NodePool::intern(const T &probe) {
+  auto found = table.find(const_cast<T *>(&probe));
+  if (found != table.end()) {
+    return *found;
+  }
+  Node *node = arena.make<T>(probe);
+  table.insert(node);
+  return node;
+}
+
+Node *NodePool::variable(Symbol name) {
+  return intern(VariableNode(name));
+}
+
+Node *NodePool::lambda(Symbol param, Node *body) {
+  return intern(LambdaNode(param, body));
+}
+
+Node *NodePool::application(Node *left, Node *right) {
+  return intern(ApplicationNode(left, right));
+}
+
+void NodePool::reset() {
+  table.clear();
+  arena.reset();
+}
+
+void NodePool::reserve(size_t count) {
+  table.reserve(table.size() + count);
+}
+
+size_t NodePool::size() const {
+  return table.size();
+}
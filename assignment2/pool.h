@@ -0,0 +1,43 @@
+// pool.h
+#ifndef POOL_H
+#define POOL_H
+
+#include "parser.h"
+#include "arena.h"
+#include <unordered_set>
+
+// Hash-consing factory for nodes. Every node is created through the pool, which returns the existing
+// node when a structurally identical one was already built, so children can be compared by pointer.
+class NodePool {
+public:
+  Node *variable(Symbol name);
+
+  Node *lambda(Symbol param, Node *body);
+
+  Node *application(Node *left, Node *right);
+
+  // Releases all nodes; called once per input line
+  void reset();
+
+  // Makes room for count more nodes, so building a term of known size never rehashes the table
+  void reserve(size_t count);
+
+  size_t size() const;
+
+private:
+  struct NodeHash {
+    size_t operator()(const Node *node) const { return node->hash; }
+  };
+
+  struct NodeEqual {
+    bool operator()(const Node *a, const Node *b) const;
+  };
+
+  Arena arena;
+  std::unordered_set<Node *, NodeHash, NodeEqual> table;
+
+  template<typename T>
+  Node *intern(const T &probe);
+};
+
+#endif //POOL_H
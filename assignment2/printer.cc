@@ -0,0 +1,180 @@
+// printer.cc
+#include "printer.h"
+#include <cstdint>
+
+// Text collected before it is written to a stream
+static const size_t CHUNK_SIZE = 1 << 16;
+
+void Printer::print(const Node *node, std::string &out) {
+  write(node, out, nullptr);
+}
+
+void Printer::print(const Node *node, std::ostream &stream) {
+  buffer.clear();
+  write(node, buffer, &stream);
+  stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+}
+
+// Children of node in the order they are printed, returning how many there are
+static int children(const Node *node, const Node *out[2]) {
+  switch (node->kind) {
+    case NodeKind::Lambda:
+      out[0] = static_cast<const LambdaNode *>(node)->body;
+      return 1;
+    case NodeKind::Application:
+      out[0] = static_cast<const ApplicationNode *>(node)->left;
+      out[1] = static_cast<const ApplicationNode *>(node)->right;
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+void Printer::analyze(const Node *root) {
+  infos.clear();
+  shared.clear();
+  const Node *next[2];
+  // Count the edges into every node, visiting each node once
+  visits.clear();
+  visits.push_back({root, false});
+  infos[root];
+  while (!visits.empty()) {
+    const Node *node = visits.back().node;
+    visits.pop_back();
+    for (int i = children(node, next); i-- > 0;) {
+      if (infos[next[i]].uses++ == 0) {
+        visits.push_back({next[i], false});
+      }
+    }
+  }
+  // Number the shared nodes and add up the sizes after the children, in the order they are printed
+  visits.push_back({root, false});
+  while (!visits.empty()) {
+    Visit &visit = visits.back();
+    Info &info = infos[visit.node];
+    int count = children(visit.node, next);
+    if (visit.expanded) {
+      visits.pop_back();
+      info.size = 1;
+      for (int i = 0; i < count; ++i) {
+        uint64_t size = infos[next[i]].size;
+        info.size = size > UINT64_MAX - info.size ? UINT64_MAX : info.size + size;
+      }
+      // A name is not shorter than a variable
+      if (sharing && info.uses > 1 && visit.node->kind != NodeKind::Variable) {
+        shared.push_back(visit.node);
+        info.name = static_cast<uint32_t>(shared.size());
+      }
+      continue;
+    }
+    if (info.visited) {
+      visits.pop_back();
+      continue;
+    }
+    info.visited = true;
+    visit.expanded = true;
+    for (int i = count; i-- > 0;) {
+      if (!infos[next[i]].visited) {
+        visits.push_back({next[i], false});
+      }
+    }
+  }
+}
+
+void Printer::write(const Node *node, std::string &out, std::ostream *stream) {
+  infos.clear();
+  shared.clear();
+  if (sharing) {
+    analyze(node);
+  }
+  // Pieces still to print, the next one last
+  pending.clear();
+  pending.push_back({node, nullptr, Piece::Function});
+  if (!shared.empty()) {
+    pending.push_back({nullptr, " in ", Piece::Function});
+    for (size_t i = shared.size(); i-- > 0;) {
+      pending.push_back({shared[i], nullptr, Piece::Definition});
+      pending.push_back({nullptr, i > 0 ? ", " : "let ", Piece::Function});
+    }
+  }
+  // Text of node from the start of out on, and the part of it already written to stream
+  size_t start = out.size();
+  size_t written = 0;
+  bool truncated = false;
+  while (!pending.empty()) {
+    if (cap && written + (out.size() - start) >= cap) {
+      truncated = true;
+      break;
+    }
+    if (stream && out.size() >= CHUNK_SIZE) {
+      stream->write(out.data(), static_cast<std::streamsize>(out.size()));
+      written += out.size() - start;
+      start = 0;
+      out.clear();
+    }
+    Piece piece = pending.back();
+    pending.pop_back();
+    if (!piece.node) {
+      out += piece.text;
+      continue;
+    }
+    if (!shared.empty()) {
+      uint32_t name = infos[piece.node].name;
+      if (piece.place == Piece::Definition) {
+        out += "@";
+        out += std::to_string(name);
+        out += " = ";
+        piece.place = Piece::Argument;
+      } else if (name) {
+        out += "@";
+        out += std::to_string(name);
+        continue;
+      }
+    }
+    switch (piece.node->kind) {
+      case NodeKind::Variable:
+        out += symbols().name(static_cast<const VariableNode *>(piece.node)->name);
+        break;
+      case NodeKind::Lambda: {
+        auto l = static_cast<const LambdaNode *>(piece.node);
+        // The parser only starts an argument at a variable or a bracket
+        bool brackets = minimal && piece.place == Piece::Argument;
+        if (brackets) {
+          out += "(";
+          pending.push_back({nullptr, ")", Piece::Function});
+        }
+        out += "\\";
+        out += symbols().name(l->param);
+        if (minimal) {
+          out += " ";
+        } else {
+          out += " (";
+          pending.push_back({nullptr, ")", Piece::Function});
+        }
+        pending.push_back({l->body, nullptr, Piece::Body});
+        break;
+      }
+      case NodeKind::Application: {
+        auto a = static_cast<const ApplicationNode *>(piece.node);
+        bool brackets = !minimal || piece.place != Piece::Function;
+        if (brackets) {
+          out += "(";
+          pending.push_back({nullptr, ")", Piece::Function});
+        }
+        pending.push_back({a->right, nullptr, Piece::Argument});
+        pending.push_back({nullptr, " ", Piece::Function});
+        pending.push_back({a->left, nullptr, Piece::Function});
+        break;
+      }
+    }
+  }
+  if (truncated || (cap && written + (out.size() - start) > cap)) {
+    out.resize(start + (cap - written));
+    if (infos.empty()) {
+      analyze(node);
+    }
+    out += "... (";
+    out += std::to_string(infos[node].size);
+    out += " nodes)";
+  }
+}
@@ -0,0 +1,78 @@
+// printer.h
+#ifndef PRINTER_H
+#define PRINTER_H
+
+#include "parser.h"
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Writes terms as text in one pass, with an explicit stack instead of recursion, so the time is linear in
+// the length of the text and no intermediate strings are built. The default format puts every application
+// and every lambda body in parentheses: \x ((f x)). The minimal format only brackets what the parser needs:
+// an application that is an argument or the body of a lambda, and a lambda that is an argument, since a
+// lambda takes a single atom as its body and applications associate to the left: \x (f x) y (\z z).
+//
+// Terms are DAGs, and a normal form can be exponentially larger as text than in memory. With sharing, every
+// application or lambda that is reached from more than one place is printed once as a binding and referred
+// to by name: let @1 = (f x), @2 = (@1 @1) in (@2 @2). A name stands for the text of its binding, so putting
+// the bindings back in gives the text without sharing. In the minimal format a binding is bracketed as an
+// argument, so that it can stand anywhere. With a cap, at most that many characters of the text are printed,
+// followed by the number of nodes the whole term has as a tree: \x ((f (f ... (1000 nodes).
+class Printer {
+public:
+  explicit Printer(bool minimal = false, bool sharing = false, size_t cap = 0)
+      : minimal(minimal), sharing(sharing), cap(cap) {}
+
+  // Appends the text of node to out
+  void print(const Node *node, std::string &out);
+
+  // Writes the text of node to stream in chunks, so a large term is never held as one string
+  void print(const Node *node, std::ostream &stream);
+
+private:
+  // Node still to print, or a literal when node is null, and where the node is in its parent
+  struct Piece {
+    // A Definition is the binding of a shared node, which is printed in full instead of as its name
+    enum Place : uint8_t {
+      Function, Argument, Body, Definition
+    };
+
+    const Node *node;
+    const char *text;
+    Place place;
+  };
+
+  // What analyze found out about a node of the term
+  struct Info {
+    uint32_t uses = 0;  // Edges into the node from the rest of the term
+    uint32_t name = 0;  // Number of its binding when it is shared, otherwise 0
+    uint64_t size = 0;  // Nodes of the node as a tree, at most UINT64_MAX
+    bool visited = false;
+  };
+
+  struct Visit {
+    const Node *node;
+    bool expanded;
+  };
+
+  bool minimal;
+  bool sharing;
+  size_t cap;
+  // Kept between calls so their capacity is reused
+  std::vector<Piece> pending;
+  std::string buffer;
+  std::unordered_map<const Node *, Info> infos;
+  std::vector<Visit> visits;
+  // Shared nodes in the order of their bindings, so every binding only refers to earlier ones
+  std::vector<const Node *> shared;
+
+  void write(const Node *node, std::string &out, std::ostream *stream);
+
+  // Fills infos for every node reachable from root without recursing, and names the shared nodes when
+  // sharing is on
+  void analyze(const Node *root);
+};
+
+#endif //PRINTER_H
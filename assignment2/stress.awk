@@ -0,0 +1,26 @@
+# stress.awk: prints a lambda term with about n nodes for the stress target of the Makefile.
+# Usage: awk -v n=1000000 -v term=spine|parens|lambdas|church -f stress.awk
+#   spine:   x0 x1 x2 ... an application spine of n variables
+#   parens:  ((( ... x ... ))) a variable inside n brackets
+#   lambdas: \x0 \x1 ... x n nested lambdas
+#   church:  (\y \f \x (f (f ... (f y)))) z substitutes into a body nested n deep
+BEGIN {
+  if (term == "spine") {
+    for (i = 0; i < n; i++) printf "x%d ", i
+    print ""
+  } else if (term == "parens") {
+    for (i = 0; i < n; i++) printf "("
+    printf "x"
+    for (i = 0; i < n; i++) printf ")"
+    print ""
+  } else if (term == "lambdas") {
+    for (i = 0; i < n; i++) printf "\\x%d ", i
+    print "x"
+  } else if (term == "church") {
+    printf "(\\y \\f \\x "
+    for (i = 0; i < n; i++) printf "(f "
+    printf "y"
+    for (i = 0; i < n; i++) printf ")"
+    print ") z"
+  }
+}
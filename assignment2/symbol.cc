@@ -0,0 +1,42 @@
+// symbol.cc
+#include "symbol.h"
+
+Symbol SymbolTable::intern(std::string_view name) {
+  auto found = ids.find(name);
+  if (found != ids.end()) {
+    return found->second;
+  }
+  Symbol symbol = static_cast<Symbol>(names.size());
+  names.emplace_back(name);
+  ids.emplace(names.back(), symbol);
+  return symbol;
+}
+
+const std::string &SymbolTable::name(Symbol symbol) const {
+  return names[symbol];
+}
+
+Symbol SymbolTable::fresh(Symbol base, const std::unordered_set<Symbol> &avoid) {
+  // Numbering starts at 1 on every call, as the interpreter did before names were interned, so interning
+  // does not change which names a reduction prints
+  unsigned counter = 1;
+  Symbol candidate;
+  do {
+    candidate = intern(names[base] + std::to_string(counter++));
+  } while (avoid.find(candidate) != avoid.end());
+  return candidate;
+}
+
+void SymbolTable::clear() {
+  ids.clear();
+  names.clear();
+}
+
+size_t SymbolTable::size() const {
+  return names.size();
+}
+
+SymbolTable &symbols() {
+  static thread_local SymbolTable table;
+  return table;
+}
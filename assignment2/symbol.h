@@ -0,0 +1,43 @@
+// symbol.h
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+typedef uint32_t Symbol;
+
+// Returned when there is no symbol, e.g. when no variable conflicts
+const Symbol NO_SYMBOL = ~Symbol(0);
+
+// Symbol table: identifiers are interned once at parse time and afterwards handled as compact integer ids,
+// so comparing or hashing a name never touches the string again. Every thread has a table of its own, so
+// the threads of the batch mode (-j) intern without locking; a term must only be used on the thread that
+// parsed it.
+class SymbolTable {
+public:
+  Symbol intern(std::string_view name);
+
+  const std::string &name(Symbol symbol) const;
+
+  // Returns a symbol named base followed by a number that is not in avoid
+  Symbol fresh(Symbol base, const std::unordered_set<Symbol> &avoid);
+
+  // Forgets all symbols, so the ids and fresh names of a line do not depend on the lines before it
+  void clear();
+
+  size_t size() const;
+
+private:
+  // The keys are views of the names, so a name is looked up straight from the input without a copy
+  std::unordered_map<std::string_view, Symbol> ids;
+  std::deque<std::string> names; // A deque keeps references returned by name() and the keys valid while interning
+};
+
+SymbolTable &symbols();
+
+#endif //SYMBOL_H
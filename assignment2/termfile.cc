@@ -0,0 +1,186 @@
+// termfile.cc
+#include "termfile.h"
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+// Codes of the node kinds in a record, fixed by the format rather than by NodeKind
+static const uint32_t CODE_VARIABLE = 0;
+static const uint32_t CODE_LAMBDA = 1;
+static const uint32_t CODE_APPLICATION = 2;
+
+// Words of the counts of a record and of one node
+static const size_t RECORD_WORDS = 3;
+static const size_t NODE_WORDS = 3;
+
+static uint32_t read_word(const char *p) {
+  uint32_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+static void append_words(std::string &out, const uint32_t *words, size_t count) {
+  out.append(reinterpret_cast<const char *>(words), count * sizeof(uint32_t));
+}
+
+static size_t padded(size_t length) {
+  return (length + 3) & ~static_cast<size_t>(3);
+}
+
+// A name the parser accepts: a letter followed by letters and digits
+static bool valid_name(std::string_view name) {
+  if (name.empty() || !std::isalpha(static_cast<unsigned char>(name[0]))) {
+    return false;
+  }
+  for (char ch : name.substr(1)) {
+    if (!std::isalpha(static_cast<unsigned char>(ch)) && !std::isdigit(static_cast<unsigned char>(ch))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void TermWriter::header(std::string &out) {
+  const uint32_t words[] = {TERM_FILE_MAGIC, TERM_FILE_VERSION};
+  append_words(out, words, 2);
+}
+
+void TermWriter::write(const Node *root, std::string &out) {
+  ids.clear();
+  names.clear();
+  nodes.clear();
+  ends.clear();
+  text.clear();
+  // Number the nodes after their children, each shared node once
+  visits.clear();
+  visits.push_back({root, false});
+  while (!visits.empty()) {
+    const Node *node = visits.back().first;
+    if (!visits.back().second) {
+      if (ids.count(node)) {
+        visits.pop_back();
+        continue;
+      }
+      visits.back().second = true;
+      if (node->kind == NodeKind::Lambda) {
+        visits.push_back({static_cast<const LambdaNode *>(node)->body, false});
+      } else if (node->kind == NodeKind::Application) {
+        visits.push_back({static_cast<const ApplicationNode *>(node)->right, false});
+        visits.push_back({static_cast<const ApplicationNode *>(node)->left, false});
+      }
+      continue;
+    }
+    visits.pop_back();
+    uint32_t code, a, b = 0;
+    if (node->kind == NodeKind::Application) {
+      code = CODE_APPLICATION;
+      a = ids.at(static_cast<const ApplicationNode *>(node)->left);
+      b = ids.at(static_cast<const ApplicationNode *>(node)->right);
+    } else {
+      Symbol symbol;
+      if (node->kind == NodeKind::Variable) {
+        code = CODE_VARIABLE;
+        symbol = static_cast<const VariableNode *>(node)->name;
+      } else {
+        code = CODE_LAMBDA;
+        symbol = static_cast<const LambdaNode *>(node)->param;
+        b = ids.at(static_cast<const LambdaNode *>(node)->body);
+      }
+      auto inserted = names.emplace(symbol, static_cast<uint32_t>(names.size()));
+      if (inserted.second) {
+        text += symbols().name(symbol);
+        ends.push_back(static_cast<uint32_t>(text.size()));
+      }
+      a = inserted.first->second;
+    }
+    ids.emplace(node, static_cast<uint32_t>(nodes.size() / NODE_WORDS));
+    nodes.push_back(code);
+    nodes.push_back(a);
+    nodes.push_back(b);
+  }
+  const uint32_t counts[RECORD_WORDS] = {static_cast<uint32_t>(ends.size()),
+                                         static_cast<uint32_t>(nodes.size() / NODE_WORDS),
+                                         static_cast<uint32_t>(text.size())};
+  append_words(out, counts, RECORD_WORDS);
+  append_words(out, ends.data(), ends.size());
+  text.resize(padded(text.size()), '\0');
+  out += text;
+  append_words(out, nodes.data(), nodes.size());
+}
+
+TermReader::TermReader(std::string_view data) : data(data) {
+  if (data.size() < 2 * sizeof(uint32_t) || read_word(data.data()) != TERM_FILE_MAGIC) {
+    throw std::runtime_error("Not a term file");
+  }
+  if (read_word(data.data() + sizeof(uint32_t)) != TERM_FILE_VERSION) {
+    throw std::runtime_error("Unsupported term file version");
+  }
+  pos = 2 * sizeof(uint32_t);
+  // Walk the records once, so next never runs past the end of a truncated file
+  for (std::string_view record; next(record);) {
+  }
+  pos = 2 * sizeof(uint32_t);
+}
+
+bool TermReader::next(std::string_view &record) {
+  if (pos == data.size()) {
+    return false;
+  }
+  size_t rest = data.size() - pos;
+  if (rest < RECORD_WORDS * sizeof(uint32_t)) {
+    throw std::runtime_error("Truncated term file");
+  }
+  const char *p = data.data() + pos;
+  // 64-bit sums, so the counts of a corrupt record cannot overflow
+  uint64_t size = RECORD_WORDS * sizeof(uint32_t) + uint64_t(read_word(p)) * sizeof(uint32_t) +
+                  padded(read_word(p + 2 * sizeof(uint32_t))) +
+                  uint64_t(read_word(p + sizeof(uint32_t))) * NODE_WORDS * sizeof(uint32_t);
+  if (size > rest) {
+    throw std::runtime_error("Truncated term file");
+  }
+  record = data.substr(pos, static_cast<size_t>(size));
+  pos += static_cast<size_t>(size);
+  return true;
+}
+
+Node *TermLoader::load(std::string_view record, NodePool &pool) {
+  // TermReader checked that the counts fit the record
+  const char *p = record.data();
+  uint32_t symbol_count = read_word(p);
+  uint32_t node_count = read_word(p + sizeof(uint32_t));
+  uint32_t text_size = read_word(p + 2 * sizeof(uint32_t));
+  const char *ends = p + RECORD_WORDS * sizeof(uint32_t);
+  const char *text = ends + symbol_count * sizeof(uint32_t);
+  const char *words = text + padded(text_size);
+  if (node_count == 0) {
+    throw std::runtime_error("Corrupt term file: empty record");
+  }
+  names.clear();
+  uint32_t start = 0;
+  for (uint32_t i = 0; i < symbol_count; ++i) {
+    uint32_t end = read_word(ends + i * sizeof(uint32_t));
+    if (end <= start || end > text_size || !valid_name(std::string_view(text + start, end - start))) {
+      throw std::runtime_error("Corrupt term file: bad name");
+    }
+    names.push_back(symbols().intern(std::string_view(text + start, end - start)));
+    start = end;
+  }
+  nodes.clear();
+  pool.reserve(node_count);
+  for (uint32_t i = 0; i < node_count; ++i, words += NODE_WORDS * sizeof(uint32_t)) {
+    uint32_t code = read_word(words);
+    uint32_t a = read_word(words + sizeof(uint32_t));
+    uint32_t b = read_word(words + 2 * sizeof(uint32_t));
+    // Children come before their parents, so an index at or after i is corrupt
+    if (code == CODE_VARIABLE && a < symbol_count) {
+      nodes.push_back(pool.variable(names[a]));
+    } else if (code == CODE_LAMBDA && a < symbol_count && b < i) {
+      nodes.push_back(pool.lambda(names[a], nodes[b]));
+    } else if (code == CODE_APPLICATION && a < i && b < i) {
+      nodes.push_back(pool.application(nodes[a], nodes[b]));
+    } else {
+      throw std::runtime_error("Corrupt term file: bad node");
+    }
+  }
+  return nodes.back();
+}
@@ -0,0 +1,71 @@
+// termfile.h
+#ifndef TERMFILE_H
+#define TERMFILE_H
+
+#include "parser.h"
+#include "pool.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Binary term file, written with -w and read back with -r. All numbers are 32-bit words in the byte order of
+// the machine. The file starts with TERM_FILE_MAGIC and TERM_FILE_VERSION, followed by one record per term:
+//
+//   symbols, nodes, text       counts of the record
+//   ends[symbols]              end of every name in text; a name starts where the one before it ends
+//   text                       the names, padded with zeros to a multiple of 4 bytes
+//   nodes[nodes]               kind, a, b per node, children before their parents and the root last
+//
+// A Variable node has its symbol in a, a Lambda node its parameter in a and its body in b, and an
+// Application node its left and right child in a and b. A record holds every name and shared subterm of its
+// term once, so a term is stored as the DAG it is in the pool. Records are self-contained: every term is
+// loaded on its own, like a line of a text file.
+const uint32_t TERM_FILE_MAGIC = 0x424d414c; // "LAMB"
+const uint32_t TERM_FILE_VERSION = 1;
+
+// Appends terms to a term file. The maps are kept between calls so their capacity is reused.
+class TermWriter {
+public:
+  // Appends the header that starts a term file
+  static void header(std::string &out);
+
+  // Appends the record of the term at root
+  void write(const Node *root, std::string &out);
+
+private:
+  std::unordered_map<const Node *, uint32_t> ids;
+  std::unordered_map<Symbol, uint32_t> names;
+  std::vector<std::pair<const Node *, bool>> visits;
+  std::vector<uint32_t> nodes;
+  std::vector<uint32_t> ends;
+  std::string text;
+};
+
+// Splits a term file, usually a mapping of the whole file, into its records without copying them
+class TermReader {
+public:
+  // Checks the header and the sizes of all records; throws std::runtime_error if data is not a term file
+  explicit TermReader(std::string_view data);
+
+  // Sets record to the next record. Returns false at the end of the file.
+  bool next(std::string_view &record);
+
+private:
+  std::string_view data;
+  size_t pos = 0;
+};
+
+// Builds the terms of records in a pool, one node per record node, with the names interned once per record
+class TermLoader {
+public:
+  // Returns the root of the term of record; throws std::runtime_error if the record is corrupt
+  Node *load(std::string_view record, NodePool &pool);
+
+private:
+  std::vector<Symbol> names;
+  std::vector<Node *> nodes;
+};
+
+#endif //TERMFILE_H
@@ -0,0 +1,202 @@
+// vm.cc
+#include "vm.h"
+#include "interpreter.h"
+
+Node *BytecodeMachine::eval(Node *node, int &iterations) {
+  // The values, terms and code of the previous expression are no longer needed
+  reset_values();
+  terms.reset();
+  quoted.clear();
+  std::vector<Symbol> binders;
+  compile(terms.from_node(node, binders));
+  CekValue *value = execute(iterations);
+  return terms.to_node(readback(value));
+}
+
+void BytecodeMachine::compile(DBTerm *term) {
+  code.clear();
+  lambdas.clear();
+  entries.clear();
+  emit(term);
+  code.push_back(Halt);
+  // A body is compiled after the code that creates its closures, so lambdas grows during the loop
+  for (size_t k = 0; k < lambdas.size(); ++k) {
+    DBTerm *body = lambdas[k]->left;
+    entries.push_back(static_cast<uint32_t>(code.size()));
+    emit(body);
+    if (body->kind == DBTerm::Application) {
+      // The result of the call is the result of the body, so the body needs no frame of its own
+      code.back() = TailApply;
+    } else {
+      code.push_back(Return);
+    }
+  }
+}
+
+void BytecodeMachine::emit(DBTerm *term) {
+  // Post-order, function before argument like CekMachine; a marked application emits its Apply
+  pending.clear();
+  pending.push_back({term, false});
+  while (!pending.empty()) {
+    std::pair<DBTerm *, bool> top = pending.back();
+    pending.pop_back();
+    DBTerm *current = top.first;
+    if (top.second) {
+      code.push_back(Apply);
+      continue;
+    }
+    switch (current->kind) {
+      case DBTerm::Bound:
+        code.push_back(Access);
+        code.push_back(current->value);
+        break;
+      case DBTerm::Free:
+        code.push_back(Free);
+        code.push_back(current->value);
+        break;
+      case DBTerm::Lambda:
+        code.push_back(Closure);
+        code.push_back(static_cast<uint32_t>(lambdas.size()));
+        lambdas.push_back(current);
+        break;
+      case DBTerm::Application:
+        pending.push_back({current, true});
+        pending.push_back({current->right, false});
+        pending.push_back({current->left, false});
+        break;
+    }
+  }
+}
+
+// Jumps to the handler of the instruction at pc: through a table of label addresses where the compiler
+// supports it, so every handler has its own indirect jump, and through a switch otherwise
+#ifdef __GNUC__
+#define NEXT goto *handlers[*pc]
+#else
+#define NEXT goto dispatch
+#endif
+
+CekValue *BytecodeMachine::execute(int &iterations) {
+  const uint32_t *pc = code.data();
+  // env and every value, caller and call started own a reference, as in CekMachine::run
+  CekEnv *env = nullptr;
+  values.clear();
+  callers.clear();
+  started.clear();
+  active.clear();
+  // Counts an instruction that evaluates a term, which CekMachine counts as one iteration as well
+  auto step = [&]() {
+    if (iterations >= max_iterations) {
+      throw std::runtime_error("Maximum number of iterations reached");
+    }
+    iterations++;
+  };
+
+#ifdef __GNUC__
+  static void *const handlers[] = {&&access, &&free, &&closure, &&apply, &&apply, &&ret, &&halt};
+  NEXT;
+#else
+  dispatch:
+  switch (*pc) {
+    case Access: goto access;
+    case Free: goto free;
+    case Closure: goto closure;
+    case Apply: goto apply;
+    case TailApply: goto apply;
+    case Return: goto ret;
+    default: goto halt;
+  }
+#endif
+
+  access: {
+    step();
+    CekEnv *entry = env;
+    for (uint32_t i = 0; i < pc[1]; ++i) {
+      entry = entry->next;
+    }
+    values.push_back(retain(entry->value));
+    pc += 2;
+    NEXT;
+  }
+
+  free: {
+    step();
+    CekValue *value = make_value(CekValue::Free);
+    value->name = pc[1];
+    value->hash = hash_combine(CekValue::Free, pc[1]);
+    values.push_back(value);
+    pc += 2;
+    NEXT;
+  }
+
+  closure: {
+    step();
+    CekValue *value = make_value(CekValue::Closure);
+    value->lambda = lambdas[pc[1]];
+    value->entry = entries[pc[1]];
+    value->env = retain(env);
+    value->hash = hash_combine(hash_combine(CekValue::Closure, value->lambda->hash), env_hash(env));
+    values.push_back(value);
+    pc += 2;
+    NEXT;
+  }
+
+  apply: {
+    step();
+    CekValue *arg = values.back();
+    values.pop_back();
+    CekValue *fn = values.back();
+    values.pop_back();
+    bool tail = *pc == TailApply;
+    if (fn->kind == CekValue::Closure) {
+      // Beta step: bind the argument and jump to the body
+      CekEnv *caller_env = env;
+      env = make_env(arg, retain(fn->env));
+      if (!tail) {
+        callers.push_back({pc + 1, caller_env});
+      } else {
+        release(caller_env);
+      }
+      // The same divergence check as CekMachine, with the callers as the stack of calls in progress
+      Start start = {fn->lambda->left, env, callers.size()};
+      if (!active.insert(start).second) {
+        throw DivergenceError("Expression does not terminate: the reduction returned to an earlier state");
+      }
+      started.push_back(start);
+      retain(env);
+      pc = code.data() + fn->entry;
+      release(fn);
+      NEXT;
+    }
+    CekValue *stuck = make_value(CekValue::Stuck);
+    stuck->fn = fn;
+    stuck->arg = arg;
+    stuck->hash = hash_combine(hash_combine(CekValue::Stuck, fn->hash), arg->hash);
+    values.push_back(stuck);
+    if (!tail) {
+      pc += 1;
+      NEXT;
+    }
+    goto ret;
+  }
+
+  ret: {
+    Caller caller = callers.back();
+    callers.pop_back();
+    // Every call started by the body and its tail calls is done
+    while (!started.empty() && started.back().depth > callers.size()) {
+      active.erase(started.back());
+      release(started.back().env);
+      started.pop_back();
+    }
+    pc = caller.pc;
+    release(env);
+    env = caller.env;
+    NEXT;
+  }
+
+  halt:
+  return values.back();
+}
+
+#undef NEXT
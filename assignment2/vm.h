@@ -0,0 +1,53 @@
+// vm.h
+#ifndef VM_H
+#define VM_H
+
+#include "cek.h"
+#include <cstdint>
+#include <vector>
+
+// Call-by-value machine on bytecode. The de Bruijn term is compiled once into a flat array of instructions,
+// one block per lambda body, and run by a dispatch loop over that array instead of by walking the term.
+// Values, environments and the readback are those of CekMachine, and so are the order of evaluation
+// and the iteration count, so both produce the same results.
+class BytecodeMachine : public CekMachine {
+public:
+  BytecodeMachine(NodePool &pool, int max_iterations = MAX_ITERATIONS, size_t cap = 0)
+      : CekMachine(pool, max_iterations, cap) {}
+
+  Node *eval(Node *node, int &iterations);
+
+private:
+  // An instruction is an opcode word, followed by one operand word for Access, Free and Closure
+  enum Opcode : uint32_t {
+    Access,    // Push the value of de Bruijn index operand
+    Free,      // Push the free variable with symbol operand
+    Closure,   // Push a closure of lambda operand over the current environment
+    Apply,     // Pop the argument and the function and apply, returning to the next instruction
+    TailApply, // Apply as the last instruction of a body, returning to the caller of the body
+    Return,    // Return the value on top of the stack to the caller of the body
+    Halt       // The value on top of the stack is the result
+  };
+
+  // Where a body returns to
+  struct Caller {
+    const uint32_t *pc;
+    CekEnv *env;
+  };
+
+  std::vector<uint32_t> code;
+  std::vector<DBTerm *> lambdas;  // Lambda of every Closure operand
+  std::vector<uint32_t> entries;  // Address of the body code of every lambda
+  // Work stacks of the compiler and the machine, kept between calls so their capacity is reused
+  std::vector<std::pair<DBTerm *, bool>> pending;
+  std::vector<CekValue *> values;
+  std::vector<Caller> callers;
+
+  void compile(DBTerm *term);
+
+  void emit(DBTerm *term);
+
+  CekValue *execute(int &iterations);
+};
+
+#endif //VM_H
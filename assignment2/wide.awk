@@ -0,0 +1,23 @@
+# wide.awk: prints n lines for the scale target of the Makefile. Every line applies a free variable to width
+# Church multiplications of numerals of up to size, each applied to the identity and a free variable as in
+# bench.awk. The head stays stuck, so the arguments are independent and can be reduced in parallel.
+# Usage: awk -v n=20 -v width=64 -v size=60 -f wide.awk
+function numeral(k,   s, i) {
+  s = "(\\f (\\x "
+  for (i = 0; i < k; i++) s = s "(f "
+  s = s "x"
+  for (i = 0; i < k; i++) s = s ")"
+  return s "))"
+}
+BEGIN {
+  mult = "(\\m (\\n (\\f (\\x ((m (n f)) x)))))"
+  for (line = 0; line < n; line++) {
+    printf "w"
+    for (i = 0; i < width; i++) {
+      a = (line + i) % size + 1
+      b = (line * 7 + i * 3) % size + 1
+      printf " ((((%s %s) %s) (\\y y)) z)", mult, numeral(a), numeral(b)
+    }
+    print ""
+  }
+}
@@ -0,0 +1,118 @@
+// workpool.cc
+#include "workpool.h"
+
+// Index of the current thread in the pool that started it; the creating thread keeps 0
+static thread_local unsigned current = 0;
+
+WorkPool::WorkPool(unsigned threads) : queued(0) {
+  for (unsigned i = 0; i < (threads > 0 ? threads : 1); ++i) {
+    queues.emplace_back(new Queue());
+  }
+  for (unsigned i = 1; i < queues.size(); ++i) {
+    this->threads.emplace_back(&WorkPool::work, this, i);
+  }
+}
+
+WorkPool::~WorkPool() {
+  {
+    std::lock_guard<std::mutex> guard(sleep);
+    done = true;
+  }
+  wakeup.notify_all();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+unsigned WorkPool::index() const {
+  return current;
+}
+
+void WorkPool::run(size_t count, const std::function<void(size_t)> &task) {
+  Group group;
+  group.task = &task;
+  group.pending = count;
+  unsigned self = index();
+  {
+    std::lock_guard<std::mutex> guard(queues[self]->lock);
+    // Pushed in reverse, so this thread takes the first call first and thieves take the last ones
+    for (size_t i = count; i > 0; --i) {
+      queues[self]->jobs.push_back({&group, i - 1});
+    }
+  }
+  queued += count;
+  if (!threads.empty()) {
+    // Taking the lock orders the notification after a sleeping thread has checked queued
+    { std::lock_guard<std::mutex> guard(sleep); }
+    wakeup.notify_all();
+  }
+
+  while (group.pending.load() > 0) {
+    Job job;
+    if (take(self, job)) {
+      execute(job);
+    } else {
+      // The remaining calls are running on other threads
+      std::this_thread::yield();
+    }
+  }
+  if (group.error) {
+    std::rethrow_exception(group.error);
+  }
+}
+
+bool WorkPool::take(unsigned self, Job &job) {
+  {
+    Queue &own = *queues[self];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if (!own.jobs.empty()) {
+      job = own.jobs.back();
+      own.jobs.pop_back();
+      --queued;
+      return true;
+    }
+  }
+  for (size_t i = 1; i < queues.size(); ++i) {
+    Queue &other = *queues[(self + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(other.lock);
+    if (!other.jobs.empty()) {
+      job = other.jobs.front();
+      other.jobs.pop_front();
+      --queued;
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkPool::execute(const Job &job) {
+  Group *group = job.group;
+  try {
+    (*group->task)(job.index);
+  } catch (...) {
+    std::lock_guard<std::mutex> guard(group->lock);
+    if (!group->error) {
+      group->error = std::current_exception();
+    }
+  }
+  // The group lives in the frame of run, which may return as soon as this reaches zero
+  --group->pending;
+}
+
+void WorkPool::work(unsigned self) {
+  current = self;
+  while (true) {
+    Job job;
+    if (take(self, job)) {
+      execute(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> guard(sleep);
+    if (done) {
+      return;
+    }
+    if (queued.load() == 0) {
+      wakeup.wait(guard);
+    }
+  }
+}
@@ -0,0 +1,73 @@
+// workpool.h
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool for fork-join parallelism. Every thread has its own queue of jobs: it takes
+// jobs from the back of its own queue and, when that is empty, steals from the front of another thread's
+// queue. The thread that creates the pool is thread 0 and takes part in the work while it waits in run.
+class WorkPool {
+public:
+  explicit WorkPool(unsigned threads);
+
+  WorkPool(const WorkPool &) = delete;
+
+  WorkPool &operator=(const WorkPool &) = delete;
+
+  ~WorkPool();
+
+  unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+  // Index of the calling thread in the pool
+  unsigned index() const;
+
+  // Calls task(i) for every i below count on the threads of the pool and returns when all calls are done.
+  // The calling thread runs calls as well, also from other runs while it waits for calls stolen by other
+  // threads, so a task may call run itself. The first exception thrown by a call is rethrown.
+  void run(size_t count, const std::function<void(size_t)> &task);
+
+private:
+  // Calls of one run
+  struct Group {
+    const std::function<void(size_t)> *task;
+    std::atomic<size_t> pending;
+    std::mutex lock;
+    std::exception_ptr error;
+  };
+
+  struct Job {
+    Group *group;
+    size_t index;
+  };
+
+  struct Queue {
+    std::mutex lock;
+    std::deque<Job> jobs;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+  // Idle threads sleep until a job is queued or the pool is destroyed
+  std::mutex sleep;
+  std::condition_variable wakeup;
+  std::atomic<size_t> queued;
+  bool done = false;
+
+  bool take(unsigned self, Job &job);
+
+  static void execute(const Job &job);
+
+  void work(unsigned self);
+};
+
+#endif //WORKPOOL_H
@@ -0,0 +1,15 @@
+# corpus.awk: prints about mb megabytes of short independent judgements for the throughput target of the
+# Makefile, with long variable and type names.
+# Usage: awk -v mb=2048 -f corpus.awk
+BEGIN {
+  total = mb * 1048576
+  for (line = 0; size < total; line++) {
+    x = "argument" line % 97
+    f = "function" line % 89
+    a = "Type" line % 101
+    b = "Result" line % 83
+    s = sprintf("(\\%s^%s (\\%s^(%s -> %s) (%s %s))) : (%s -> ((%s -> %s) -> %s))", x, a, f, a, b, f, x, a, a, b, b)
+    print s
+    size += length(s) + 1
+  }
+}
@@ -0,0 +1,55 @@
+// input.cc
+#include "input.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+InputFile::InputFile(const char *path) {
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+    void *mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      // The lines are read once from front to back
+      madvise(mapped, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+      mapping = mapped;
+      data = static_cast<const char *>(mapped);
+      length = static_cast<size_t>(info.st_size);
+      open = true;
+    }
+  }
+  if (!mapping) {
+    char chunk[1 << 16];
+    ssize_t count;
+    while ((count = read(fd, chunk, sizeof(chunk))) > 0) {
+      buffer.append(chunk, static_cast<size_t>(count));
+    }
+    data = buffer.data();
+    length = buffer.size();
+    open = count == 0;
+  }
+  close(fd);
+}
+
+InputFile::~InputFile() {
+  if (mapping) {
+    munmap(mapping, length);
+  }
+}
+
+bool InputFile::next(std::string_view &line) {
+  if (pos >= length) {
+    return false;
+  }
+  const char *start = data + pos;
+  const char *end = static_cast<const char *>(std::memchr(start, '\n', length - pos));
+  size_t size = end ? static_cast<size_t>(end - start) : length - pos;
+  line = std::string_view(start, size);
+  pos += end ? size + 1 : size;
+  return true;
+}
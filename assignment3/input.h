@@ -0,0 +1,40 @@
+// input.h
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Input file mapped into memory. Lines are views into the mapping, so reading a line copies nothing and the
+// parser works on the bytes of the file itself. A file that cannot be mapped, like a pipe, is read into a
+// buffer instead.
+class InputFile {
+public:
+  explicit InputFile(const char *path);
+
+  InputFile(const InputFile &) = delete;
+
+  InputFile &operator=(const InputFile &) = delete;
+
+  ~InputFile();
+
+  // False if the file could not be opened or read
+  bool is_open() const { return open; }
+
+  size_t size() const { return length; }
+
+  // Sets line to the next line without its '\n', like std::getline. Returns false at the end of the file.
+  // The view stays valid as long as the file.
+  bool next(std::string_view &line);
+
+private:
+  bool open = false;
+  const char *data = nullptr;
+  size_t length = 0;
+  size_t pos = 0;
+  void *mapping = nullptr;
+  std::string buffer; // Contents of a file that could not be mapped
+};
+
+#endif //INPUT_H
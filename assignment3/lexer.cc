@@ -0,0 +1,89 @@
+// lexer.cc
+#include "lexer.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Every block scan loads whole blocks only, so it never reads past the end of text; the scalar loops finish
+// the last partial block and are all there is on other targets. A class mask has a bit set for every byte
+// of the block in the class, so the first byte outside it is the lowest zero bit.
+#if defined(__AVX2__)
+static const size_t BLOCK = 32;
+
+static unsigned space_mask(const char *p) {
+  __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  // Bytes are signed, so bytes from 0x80 are below every ASCII class
+  __m256i blank = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(' '));
+  __m256i control = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('\t' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), c));
+  return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(blank, control)));
+}
+
+static unsigned alnum_mask(const char *p) {
+  __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  // Setting bit 5 maps upper case letters to lower case ones
+  __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+  __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                   _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+  __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                                   _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+  return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(alpha, digit)));
+}
+#elif defined(__SSE2__)
+static const size_t BLOCK = 16;
+
+static unsigned space_mask(const char *p) {
+  __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  // Bytes are signed, so bytes from 0x80 are below every ASCII class
+  __m128i blank = _mm_cmpeq_epi8(c, _mm_set1_epi8(' '));
+  __m128i control = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('\t' - 1)),
+                                  _mm_cmplt_epi8(c, _mm_set1_epi8('\r' + 1)));
+  return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(blank, control))) | ~0xffffu;
+}
+
+static unsigned alnum_mask(const char *p) {
+  __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  // Setting bit 5 maps upper case letters to lower case ones
+  __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+  return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(alpha, digit))) | ~0xffffu;
+}
+#endif
+
+size_t skip_space(std::string_view text, size_t pos) {
+  // A single space between tokens is the common case and not worth a block
+  if (pos < text.size() && !is_space(text[pos])) {
+    return pos;
+  }
+#if defined(__AVX2__) || defined(__SSE2__)
+  for (; pos + BLOCK <= text.size(); pos += BLOCK) {
+    unsigned outside = ~space_mask(text.data() + pos);
+    if (outside) {
+      return pos + static_cast<size_t>(__builtin_ctz(outside));
+    }
+  }
+#endif
+  while (pos < text.size() && is_space(text[pos])) {
+    ++pos;
+  }
+  return pos;
+}
+
+size_t skip_alnum(std::string_view text, size_t pos) {
+#if defined(__AVX2__) || defined(__SSE2__)
+  for (; pos + BLOCK <= text.size(); pos += BLOCK) {
+    unsigned outside = ~alnum_mask(text.data() + pos);
+    if (outside) {
+      return pos + static_cast<size_t>(__builtin_ctz(outside));
+    }
+  }
+#endif
+  while (pos < text.size() && is_alnum(text[pos])) {
+    ++pos;
+  }
+  return pos;
+}
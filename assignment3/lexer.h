@@ -0,0 +1,30 @@
+// lexer.h
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <cstddef>
+#include <string_view>
+
+// Character classes of the tokenizer. They are defined for ASCII, like the "C" locale the program runs in,
+// so they do not look up the locale for every byte the way std::isspace and std::isalpha do.
+inline bool is_space(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline bool is_alpha(char c) {
+  return (c | 0x20) >= 'a' && (c | 0x20) <= 'z';
+}
+
+inline bool is_alnum(char c) {
+  return is_alpha(c) || (c >= '0' && c <= '9');
+}
+
+// Index of the first byte at or after pos that is not whitespace, or the size of text. Runs of whitespace
+// are skipped 16 or 32 bytes at a time with SSE2 or AVX2 where the compiler targets them.
+size_t skip_space(std::string_view text, size_t pos);
+
+// Index of the first byte at or after pos that is not a letter or digit, or the size of text, so the
+// identifier starting before pos ends there. Scans in blocks like skip_space.
+size_t skip_alnum(std::string_view text, size_t pos);
+
+#endif //LEXER_H
@@ -1,43 +1,149 @@
 #include "parser.h"
+#include "workpool.h"
+#include "input.h"
+#include "printer.h"
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
 #include <string>
-#include <fstream>
+#include <memory>
+#include <sstream>
 #include <unordered_set>
+#include <vector>
 
-int main(int argc, char *argv[]) {
-  if (argc > 3 || argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " [file_name] <-d>" << std::endl;
+static int usage(const char *program) {
+  std::cerr << "Usage: " << program << " [file_name] <-d> <-m> <-j threads>" << std::endl;
+  return 1;
+}
+
+// Outcome of one line in batch mode, kept until the lines before it are written
+struct Result {
+  std::string out;
+  std::string err;
+  int status = 0;
+};
+
+// Lines read ahead in batch mode; a batch is written once all of its lines are done
+static const size_t BATCH_LINES = 4096;
+
+// Parses and type-checks one line, writing the judgement to out and an error to err. Returns the exit status
+// of the program when the line fails and 0 otherwise.
+static int process(std::string_view line, bool debugMode, Parser &parser, Printer &printer, std::ostream &out,
+                   std::ostream &err) {
+  // Every line starts with an empty symbol table, so the table does not grow with the whole file
+  symbols().clear();
+  // Parse the line. Its nodes stay in the store of the parser until the next line is parsed.
+  try {
+    Term root = parser.parse(line);
+    out << "Parsed successfully: ";
+    printer.print(parser.terms(), root, out);
+    out << '\n';
+    if (debugMode) {
+      out << "Dot Tree: \n";
+      parser.generate_dot(root, out);
+      out << '\n';
+    }
+  } catch (std::runtime_error &e) {
+    err << "Error: " << e.what() << std::endl;
     return 1;
   }
+  return 0;
+}
+
+// Batch mode (-j): the lines of a batch are checked on the threads of a pool, each with a parser of its own,
+// and their results are written in input order. Like the sequential loop, it stops at the first line that
+// fails, after writing the lines before it; lines after it are skipped.
+static int batch(InputFile &in, bool debugMode, bool minimal, unsigned jobs) {
+  WorkPool workers(jobs);
+  std::vector<std::unique_ptr<Parser>> parsers;
+  std::vector<std::unique_ptr<Printer>> printers;
+  for (unsigned i = 0; i < workers.size(); ++i) {
+    parsers.emplace_back(new Parser());
+    printers.emplace_back(new Printer(minimal));
+  }
+  // Views into the mapped input, so a batch is not copied
+  std::vector<std::string_view> lines(BATCH_LINES);
+  std::vector<Result> results;
+  while (true) {
+    size_t count = 0;
+    while (count < BATCH_LINES && in.next(lines[count])) {
+      ++count;
+    }
+    if (count == 0) {
+      return 0;
+    }
+    results.assign(count, Result());
+    // Index of the first line that failed so far
+    std::atomic<size_t> failed(count);
+    workers.run(count, [&](size_t i) {
+      if (i > failed.load()) {
+        return;
+      }
+      Result &result = results[i];
+      std::ostringstream out, err;
+      result.status = process(lines[i], debugMode, *parsers[workers.index()], *printers[workers.index()], out, err);
+      result.out = out.str();
+      result.err = err.str();
+      size_t first = failed.load();
+      while (result.status != 0 && i < first && !failed.compare_exchange_weak(first, i)) {
+      }
+    });
+    for (Result &result : results) {
+      std::cout << result.out;
+      std::cerr << result.err;
+      if (result.status != 0) {
+        return result.status;
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    return usage(argv[0]);
+  }
 
-  std::ifstream inFile(argv[1]);
-  if (!inFile) {
+  bool debugMode = false;
+  bool minimal = false;
+  long jobs = 0;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-d") {
+      debugMode = true;
+    } else if (arg == "-m") {
+      minimal = true;
+    } else if (arg == "-j" && i + 1 < argc) {
+      char *end;
+      jobs = std::strtol(argv[++i], &end, 10);
+      if (*end || jobs <= 0 || jobs > 1024) {
+        return usage(argv[0]);
+      }
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  InputFile inFile(argv[1]);
+  if (!inFile.is_open()) {
     std::cerr << "Cannot open input file: " << argv[1] << std::endl;
     return 1;
   }
 
-  bool debugMode = (argc == 3 && std::string(argv[2]) == "-d");
-  std::string line;
+  if (jobs > 0) {
+    return batch(inFile, debugMode, minimal, static_cast<unsigned>(jobs));
+  }
+
+  std::string_view line;
   Parser parser;
+  Printer printer(minimal);
 
   // Read line by line
-  while (std::getline(inFile, line)) {
-    Node *root;
-    // Parse the line
-    try {
-      root = parser.parse(line);
-      std::cout << "Parsed successfully: " << root->to_string() << std::endl;
-      if (debugMode) {
-        std::cout << "Dot Tree: \n" << parser.generate_dot(root, -1) << std::endl;
-      }
-    } catch (std::runtime_error &e) {
-      std::cerr << "Error: " << e.what() << std::endl;
-      return 1;
+  while (inFile.next(line)) {
+    int status = process(line, debugMode, parser, printer, std::cout, std::cerr);
+    if (status != 0) {
+      return status;
     }
-
-    delete root;
   }
 
   return 0;
 }
-
@@ -1,214 +1,203 @@
 // parser.cc
 #include "parser.h"
-#include <sstream>
+#include "lexer.h"
+#include "printer.h"
 
-VariableNode::VariableNode(const std::string &name)
-    : name(name) {}
-
-
-std::string VariableNode::to_string() const {
-  return name;
-}
-
-LambdaNode::LambdaNode(const std::string &param, Node *type, Node *body)
-    : param(param), type(type), body(body) {}
-
-std::string LambdaNode::to_string() const {
-  std::string typeStr = type ? type->to_string() : "";
-  return "\\" + param + (typeStr.empty() ? "" : "^" + typeStr) + " " + body->to_string();
-}
-
-LambdaNode::~LambdaNode() {
-  delete body;
-  delete type;
-}
-
-ApplicationNode::ApplicationNode(Node *left, Node *right) : left(left), right(right) {}
-
-std::string ApplicationNode::to_string() const {
-  return "(" + left->to_string() + " " + right->to_string() + ")";
-}
-
-ApplicationNode::~ApplicationNode() {
-  delete left;
-  delete right;
-}
-
-TypeNode::TypeNode(const std::string &body) : body(body) {}
-
-std::string TypeNode::to_string() const {
-  return body;
-}
-
-JudgementNode::JudgementNode(Node *left, Node *right) : left(left), right(right) {}
-
-std::string JudgementNode::to_string() const {
-  return "(" + left->to_string() + ") : (" + right->to_string() + ")";
-}
-
-JudgementNode::~JudgementNode() {
-  delete left;
-  delete right;
-}
-
-void Parser::tokenize(const std::string &inputString) {
+void Parser::tokenize(std::string_view inputString) {
+  // Offsets are 32 bits to keep tokens small
+  if (inputString.size() > UINT32_MAX) {
+    throw std::runtime_error("Input line too long");
+  }
   size_t lpos = 0;
-  while (lpos < inputString.length()) {
+  while ((lpos = skip_space(inputString, lpos)) < inputString.size()) {
     char current = inputString[lpos];
-    if (std::isspace(current)) {
-      lpos++;
-      continue;
-    }
-
-    if (current == '\\') {
-      tokens.push_back({TokenType::Lambda, "\\"});
-      lpos++;
-    } else if (current == '(') {
-      tokens.push_back({TokenType::LParen, "("});
-      lpos++;
-    } else if (current == ')') {
-      tokens.push_back({TokenType::RParen, ")"});
-      lpos++;
-    } else if (current == '.') {
-      tokens.push_back({TokenType::Dot, "."});
-      lpos++;
-    } else if (current == ':') {
-      tokens.push_back({TokenType::Colon, ":"});
-      lpos++;
-    } else if (std::isalpha(current)) {
-      std::string value;
-      do {
-        value += inputString[lpos++];
-      } while (lpos < inputString.length() && std::isalnum(inputString[lpos]));
-
-      if (std::isupper(value[0])) {
-        tokens.push_back({TokenType::UVar, value});
-      } else {
-        tokens.push_back({TokenType::LVar, value});
-      }
-    } else if (current == '-' && lpos + 1 < inputString.length() && inputString[lpos + 1] == '>') {
-      tokens.push_back({TokenType::Arrow, "->"});
-      lpos += 2; // Skip past '->'
-    } else if (current == '^') {
-      tokens.push_back({TokenType::Caret, "^"});
-      lpos++;
-    } else {
-      throw std::runtime_error("Unexpected token");
+    uint32_t offset = static_cast<uint32_t>(lpos);
+    TokenType type;
+    switch (current) {
+      case '\\':
+        type = TokenType::Lambda;
+        break;
+      case '(':
+        type = TokenType::LParen;
+        break;
+      case ')':
+        type = TokenType::RParen;
+        break;
+      case '.':
+        type = TokenType::Dot;
+        break;
+      case ':':
+        type = TokenType::Colon;
+        break;
+      case '^':
+        type = TokenType::Caret;
+        break;
+      case '-':
+        if (lpos + 1 < inputString.size() && inputString[lpos + 1] == '>') {
+          tokens.push_back({TokenType::Arrow, offset, 2});
+          lpos += 2; // Skip past '->'
+          continue;
+        }
+        throw std::runtime_error("Unexpected token");
+      default:
+        if (!is_alpha(current)) {
+          throw std::runtime_error("Unexpected token");
+        }
+        // The identifier ends at the first byte that is not a letter or digit
+        lpos = skip_alnum(inputString, lpos + 1);
+        type = current >= 'A' && current <= 'Z' ? TokenType::UVar : TokenType::LVar;
+        tokens.push_back({type, offset, static_cast<uint32_t>(lpos - offset)});
+        continue;
     }
+    tokens.push_back({type, offset, 1});
+    lpos++;
   }
 
-  tokens.push_back({TokenType::End, ""});
+  tokens.push_back({TokenType::End, static_cast<uint32_t>(inputString.size()), 0});
 }
 
-Node *Parser::parse_judgement() {
+Term Parser::parse_judgement() {
   // ⟨judgement⟩ ::= ⟨expr⟩ ':' ⟨type⟩
-  Node *expr = parse_expression();
+  Term expr = parse_expression();
 
   if (tokens[pos].type != TokenType::Colon) {
     throw std::runtime_error("Missing type for judgement");
   }
   pos++; // consume ':'
 
-  Node *type = parse_type();
-  return new JudgementNode(expr, type);
+  Term type = parse_type();
+  return store.judgement(expr, type);
 }
 
 
-Node *Parser::parse_expression() {
+Term Parser::parse_expression() {
   // ⟨expr⟩ ::= ⟨lvar⟩ | '(' ⟨expr⟩ ')' | '\' ⟨lvar⟩ '^' ⟨type⟩ ⟨expr⟩ | ⟨expr⟩ ⟨expr⟩
-  Node *expr = parse_atom();
+  frames.clear();
+  frames.push_back({Frame::Group, 0, NO_TERM, NO_TERM});
 
   while (true) {
-    // Check if the current character is the start of a new atom
-    if (tokens[pos].type == TokenType::LParen || std::isalpha(tokens[pos].value[0])) {
-      Node *right = parse_atom();
-      expr = new ApplicationNode(expr, right);
-    } else {
-      break; // No more applications, exit loop
+    Term atom = parse_atom();
+    if (atom == NO_TERM) {
+      continue; // Opened a bracket or a lambda, whose expression starts with another atom
     }
-  }
 
-  return expr;
+    while (true) {
+      Frame &top = frames.back();
+      top.expr = top.expr != NO_TERM ? store.application(top.expr, atom) : atom;
+      // Check if the current token is the start of a new atom
+      if (tokens[pos].type == TokenType::LParen || tokens[pos].type == TokenType::LVar ||
+          tokens[pos].type == TokenType::UVar) {
+        break;
+      }
+      // No more applications, the innermost open expression ends here
+      if (top.kind == Frame::Lambda) {
+        atom = store.lambda(top.param, top.type, top.expr);
+      } else if (frames.size() == 1) {
+        return top.expr;
+      } else if (tokens[pos].type == TokenType::RParen) {
+        pos++; // consume ')'
+        atom = top.expr;
+      } else {
+        throw std::runtime_error("Expected ')' but got '" + std::string(text(tokens[pos])) + "' instead.");
+      }
+      frames.pop_back();
+    }
+  }
 }
 
-Node *Parser::parse_atom() {
+Term Parser::parse_atom() {
   // ⟨atom⟩ ::= ⟨lvar⟩ | '(' ⟨expr⟩ ')' | '\' ⟨lvar⟩ '^' ⟨type⟩ ⟨expr⟩
+  // Returns a variable, or NO_TERM after opening a bracket or a lambda on the frame stack
   if (tokens[pos].type == TokenType::LVar) {
-    std::string varName = tokens[pos++].value; // Consume the LVar
+    Symbol varName = symbols().intern(text(tokens[pos++])); // Consume the LVar
 
-    return new VariableNode(varName);
+    return store.variable(varName);
   } else if (tokens[pos].type == TokenType::LParen) {
     pos++; // consume '('
-    Node *node = parse_expression(); // parse expression within the brackets
-    if (tokens[pos].type == TokenType::RParen) {
-      pos++; // consume ')'
-    } else {
-      throw std::runtime_error("Expected ')' but got '" + tokens[pos].value + "' instead.");
-    }
-    return node;
+    frames.push_back({Frame::Group, 0, NO_TERM, NO_TERM});
+    return NO_TERM;
   } else if (tokens[pos].type == TokenType::Lambda) {
-    return parse_lambda();
+    parse_lambda();
+    return NO_TERM;
   } else {
-    throw std::runtime_error("Unexpected character encountered: " + tokens[pos].value + "");
+    throw std::runtime_error("Unexpected character encountered: " + std::string(text(tokens[pos])));
   }
 }
 
-Node *Parser::parse_lambda() {
+void Parser::parse_lambda() {
   // '\' ⟨lvar⟩ '^' ⟨type⟩ '.' ⟨expr⟩
   pos++; // Skip the '\' character
   if (tokens[pos].type != TokenType::LVar) {
     throw std::runtime_error("Expected lambda parameter");
   }
-  std::string param = tokens[pos].value;
+  Symbol param = symbols().intern(text(tokens[pos]));
   pos++; // Consume the parameter
   if (tokens[pos].type != TokenType::Caret) {
     throw std::runtime_error("Missing type for lambda parameter");
   }
   pos++; // Consume '^'
 
-  Node *type = parse_type(); // Parse the type
+  Term type = parse_type(); // Parse the type
 
-  Node *body = parse_expression(); // Parse the body of the lambda
-  return new LambdaNode(param, type, body); // Pass the type to the constructor
+  // The body of the lambda is the expression that follows
+  frames.push_back({Frame::Lambda, param, type, NO_TERM});
 }
 
-Node *Parser::parse_single_type() {
-  // ⟨type⟩ ::= ⟨uvar⟩ | '(' ⟨type⟩ ')'
-  if (tokens[pos].type == TokenType::UVar) {
-    return new TypeNode(tokens[pos++].value);
-  } else if (tokens[pos].type == TokenType::LParen) {
-    pos++; // Consume '('
-    Node *innerType = parse_type(); // Parse the inner type expression
+Term Parser::parse_type() {
+  // ⟨type⟩ ::= ⟨single_type⟩ | ⟨single_type⟩ '->' ⟨type⟩
+  // ⟨single_type⟩ ::= ⟨uvar⟩ | '(' ⟨type⟩ ')'
+  // Text of the types of the enclosing brackets parsed so far, innermost last; empty before their first
+  // single type. Only the whole type is interned and stored as a node.
+  std::vector<std::string> groups;
+  std::string type;
 
-    if (tokens[pos].type != TokenType::RParen) {
-      throw std::runtime_error("Expected ')' but got '" + tokens[pos].value + "' instead.");
+  while (true) {
+    std::string single;
+    if (tokens[pos].type == TokenType::UVar) {
+      single = text(tokens[pos++]);
+    } else if (tokens[pos].type == TokenType::LParen) {
+      pos++; // Consume '('
+      groups.push_back(std::move(type));
+      type.clear();
+      continue;
+    } else {
+      throw std::runtime_error("Unexpected type token");
     }
-    pos++; // Consume ')'
-    return innerType;
-  } else {
-    throw std::runtime_error("Unexpected type token");
-  }
-}
 
-Node *Parser::parse_type() {
-  // ⟨type⟩ ::= ⟨single_type⟩ | ⟨single_type⟩ '->' ⟨type⟩
-  Node *leftType = parse_single_type();
-  // Check for '->' to handle function types
-  while (tokens[pos].type == TokenType::Arrow) {
-    pos++; // Consume '->'
-    Node *rightType = parse_single_type();
-    leftType = new TypeNode(leftType->to_string() + " -> " + rightType->to_string());
+    while (true) {
+      if (!type.empty()) {
+        type += " -> ";
+        type += single;
+      } else {
+        type = std::move(single);
+      }
+      // Check for '->' to handle function types
+      if (tokens[pos].type == TokenType::Arrow) {
+        pos++; // Consume '->'
+        break;
+      }
+      if (groups.empty()) {
+        return store.type(symbols().intern(type));
+      }
+      if (tokens[pos].type != TokenType::RParen) {
+        throw std::runtime_error("Expected ')' but got '" + std::string(text(tokens[pos])) + "' instead.");
+      }
+      pos++; // Consume ')'
+      // The bracketed type is a single type of the enclosing one
+      single = std::move(type);
+      type = std::move(groups.back());
+      groups.pop_back();
+    }
   }
-
-  return leftType;
 }
 
-Node *Parser::parse(const std::string &input_str) {
+Term Parser::parse(std::string_view input_str) {
   input = input_str;
   pos = 0;
   tokens.clear();
+  store.clear();
   tokenize(input);
-  Node *result = parse_judgement();
+  Term result = parse_judgement();
   if (!get_derivation(result)) throw std::runtime_error("Derivation incorrect");
 
   if (pos < tokens.size() && tokens[pos].type != TokenType::End) {
@@ -218,10 +207,10 @@ Node *Parser::parse(const std::string &input_str) {
   return result;
 }
 
-bool Parser::get_derivation(Node *root) {
-  Node *left = get_type(dynamic_cast<JudgementNode *>(root)->left);
-  Node *right = dynamic_cast<JudgementNode *>(root)->right;
-  return (left->to_string() == right->to_string());
+bool Parser::get_derivation(Term root) {
+  // A line that failed may have left its context behind
+  gamma_stack = std::stack<Gamma>();
+  return get_type(store.left(root)) == store.symbol(store.right(root));
 }
 
 std::pair<std::string, std::string> Parser::extract_types(const std::string &str) {
@@ -236,58 +225,129 @@ std::pair<std::string, std::string> Parser::extract_types(const std::string &str
   return {firstType, secondType};
 }
 
-Node *Parser::get_type(Node *root) {
-  // Lambda Rule: Γ, x : A ⊢ M : B
-  if (auto l = dynamic_cast<LambdaNode *>(root)) {
-    gamma_stack.push({l->param, l->type->to_string()});
-    Node *temp = new TypeNode(l->type->to_string() + " -> " + get_type(l->body)->to_string());
-    return temp;
-  } else if (auto a = dynamic_cast<ApplicationNode *>(root)) { // Application Rule: Γ ⊢ M : A -> B    Γ ⊢ N : A
-    Node *left = get_type(a->left);
-    Node *right = get_type(a->right);
-    std::pair<std::string, std::string> types = extract_types(left->to_string());
-    if (types.first != right->to_string()) throw std::runtime_error("Type mismatch");
-    Node *temp = new TypeNode(types.second);
-    return temp;
-  } else if (auto v = dynamic_cast<VariableNode *>(root)) { // Variable Rule: Γ, x : A ⊢ x : A
-    if (gamma_stack.empty()) throw std::runtime_error("Variable has unknown type");
-    if (v->to_string() != gamma_stack.top().var) throw std::runtime_error("Variable not in scope");
-    std::string type = gamma_stack.top().type;
-    gamma_stack.pop();
-    return new TypeNode(type);
-  } else {
-    throw std::runtime_error("Unexpected node type: " + root->to_string());
+Symbol Parser::get_type(Term root) {
+  // Nodes still to type; a node is pushed again with ready set once the types of its children are known
+  std::vector<std::pair<Term, bool>> pending = {{root, false}};
+  std::vector<Symbol> types;
+  while (!pending.empty()) {
+    Term node = pending.back().first;
+    bool ready = pending.back().second;
+    pending.pop_back();
+    switch (store.kind(node)) {
+      case NodeKind::Lambda: { // Lambda Rule: Γ, x : A ⊢ M : B
+        Symbol type = store.symbol(store.left(node));
+        if (ready) {
+          types.back() = symbols().intern(symbols().name(type) + " -> " + symbols().name(types.back()));
+        } else {
+          gamma_stack.push({store.symbol(node), type});
+          pending.push_back({node, true});
+          pending.push_back({store.right(node), false});
+        }
+        break;
+      }
+      case NodeKind::Application: { // Application Rule: Γ ⊢ M : A -> B    Γ ⊢ N : A
+        if (ready) {
+          Symbol right = types.back();
+          types.pop_back();
+          std::pair<std::string, std::string> parts = extract_types(symbols().name(types.back()));
+          if (parts.first != symbols().name(right)) throw std::runtime_error("Type mismatch");
+          types.back() = symbols().intern(parts.second);
+        } else {
+          pending.push_back({node, true});
+          pending.push_back({store.right(node), false});
+          pending.push_back({store.left(node), false});
+        }
+        break;
+      }
+      case NodeKind::Variable: { // Variable Rule: Γ, x : A ⊢ x : A
+        if (gamma_stack.empty()) throw std::runtime_error("Variable has unknown type");
+        if (store.symbol(node) != gamma_stack.top().var) throw std::runtime_error("Variable not in scope");
+        types.push_back(gamma_stack.top().type);
+        gamma_stack.pop();
+        break;
+      }
+      default: {
+        std::string text;
+        Printer().print(store, node, text);
+        throw std::runtime_error("Unexpected node type: " + text);
+      }
+    }
   }
+  return types.back();
 }
 
-std::string Parser::generate_dot(Node *node, int parent_id = -1) {
-  static int counter = 0;
-  std::ostringstream out;
-
-  if (!node) return "";
-
-  int cur_id = counter++;
-  std::string label = node->to_string();
-
-  if (parent_id != -1) {
-    // Draw an edge from the parent node to the current node
-    out << parent_id << " -> " << cur_id << ";\n";
-  }
-
-  if (auto l = dynamic_cast<LambdaNode *>(node)) {
-    // LambdaNode has a body and optionally a type
-    out << generate_dot(l->type, cur_id);
-    out << generate_dot(l->body, cur_id);
-  } else if (auto a = dynamic_cast<ApplicationNode *>(node)) {
-    // ApplicationNode has left and right children
-    out << generate_dot(a->left, cur_id);
-    out << generate_dot(a->right, cur_id);
-  } else if (auto j = dynamic_cast<JudgementNode *>(node)) {
-    // JudgementNode has left and right children
-    out << generate_dot(j->left, cur_id);
-    out << generate_dot(j->right, cur_id);
+// Text of a graph collected before it is written to the stream
+static const size_t DOT_CHUNK_SIZE = 1 << 16;
+
+void Parser::generate_dot(Term node, std::ostream &out) {
+  // A node still to visit and the id of its parent, or with label set, a visited node whose label is next
+  struct Step {
+    Term node;
+    int id;
+    bool label;
+  };
+  std::vector<Step> steps;
+  // Text collected before it is written to out
+  std::string text;
+  // Numbered per graph, so the graph of a line does not depend on the lines before it
+  int ids = 0;
+  steps.push_back({node, -1, false});
+  while (!steps.empty()) {
+    if (text.size() >= DOT_CHUNK_SIZE) {
+      out.write(text.data(), static_cast<std::streamsize>(text.size()));
+      text.clear();
+    }
+    Step step = steps.back();
+    steps.pop_back();
+    if (step.node == NO_TERM) {
+      continue;
+    }
+    if (step.label) {
+      text += std::to_string(step.id);
+      text += " [label=\"";
+      switch (store.kind(step.node)) {
+        case NodeKind::Variable:
+          text += "Variable: ";
+          text += symbols().name(store.symbol(step.node));
+          break;
+        case NodeKind::Lambda:
+          // The type of the parameter is a child of its own
+          text += "Lambda: ";
+          text += symbols().name(store.symbol(step.node));
+          break;
+        case NodeKind::Application:
+          text += "Application";
+          break;
+        case NodeKind::Type:
+          text += "Type: ";
+          text += symbols().name(store.symbol(step.node));
+          break;
+        case NodeKind::Judgement:
+          text += "Judgement";
+          break;
+      }
+      text += "\"];\n";
+      continue;
+    }
+    int id = ids++;
+    if (step.id != -1) {
+      // Draw an edge from the parent node to the current node
+      text += std::to_string(step.id);
+      text += " -> ";
+      text += std::to_string(id);
+      text += ";\n";
+    }
+    steps.push_back({step.node, id, true});
+    switch (store.kind(step.node)) {
+      case NodeKind::Lambda:
+      case NodeKind::Application:
+      case NodeKind::Judgement:
+        steps.push_back({store.right(step.node), id, false});
+        steps.push_back({store.left(step.node), id, false});
+        break;
+      default:
+        break;
+    }
   }
-
-  out << cur_id << " [label=\"" << label << "\"];\n";
-  return out.str();
+  out.write(text.data(), static_cast<std::streamsize>(text.size()));
 }
@@ -3,140 +3,85 @@
 #define PARSER_H
 
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <vector>
 #include <cctype>
 #include <stack>
-
-class Node {
-public:
-  virtual std::string to_string() const = 0;
-
-  virtual Node *copy() const = 0;
-
-  virtual ~Node() = default;
-};
-
-class VariableNode : public Node {
-public:
-  std::string name;
-
-  VariableNode(const std::string &name);
-
-  std::string to_string() const override;
-
-  Node *copy() const override {
-    return new VariableNode(name);
-  }
-};
-
-class LambdaNode : public Node {
-public:
-  std::string param;
-  Node *type;
-  Node *body;
-
-  LambdaNode(const std::string &param, Node *type, Node *body);
-
-  std::string to_string() const override;
-
-  Node *copy() const override {
-    return new LambdaNode(param, type ? type->copy() : nullptr, body->copy());
-  }
-
-  ~LambdaNode() override;
-};
-
-
-class ApplicationNode : public Node {
-public:
-  Node *left;
-  Node *right;
-
-  ApplicationNode(Node *left, Node *right);
-
-  std::string to_string() const override;
-
-  Node *copy() const override {
-    return new ApplicationNode(left->copy(), right->copy());
-  }
-
-  ~ApplicationNode() override;
-};
-
-class TypeNode : public Node {
-public:
-  std::string body;
-
-  TypeNode(const std::string &body);
-
-  std::string to_string() const override;
-
-  Node *copy() const override {
-    return new TypeNode(*this);
-  }
-};
-
-class JudgementNode : public Node {
-public:
-  Node *left;
-  Node *right;
-
-  std::string to_string() const override;
-
-  Node *copy() const override {
-    return new JudgementNode(left->copy(), right->copy());
-  }
-
-  ~JudgementNode() override;
-
-public:
-  JudgementNode(Node *left, Node *right);
-};
+#include <cstdint>
+#include "symbol.h"
+#include "store.h"
 
 enum class TokenType {
   Lambda, Arrow, LParen, RParen, Dot, End, LVar, UVar, Caret, Colon
 };
 
+// Token of the input line: its kind and where its text is in the line
 struct Token {
   TokenType type;
-  std::string value;
+  uint32_t offset;
+  uint32_t length;
 };
 
 struct Gamma {
-  std::string var;
-  std::string type;
+  Symbol var;
+  Symbol type; // Interned text of the type
 };
 
 class Parser {
 public:
-  Node *parse(const std::string &input_str);
+  // Parses one line into the store, replacing the judgement of the line before. No node refers to input, so
+  // it only has to stay valid during the call.
+  Term parse(std::string_view input_str);
+
+  // Nodes of the last judgement parsed
+  const TermStore &terms() const { return store; }
 
-  void tokenize(const std::string &inputString);
+  void tokenize(std::string_view inputString);
 
-  std::string generate_dot(Node *node, int parent_id);
+  // Writes the nodes and edges of the tree of node to out, in one pass with an explicit stack. Ids are
+  // numbered per call from 0.
+  void generate_dot(Term node, std::ostream &out);
 
 private:
-  std::string input;
+  // Construct that is still open while parsing an expression: the top level or a bracketed expression
+  // (Group), or a lambda whose body is being parsed. They are kept on a heap stack instead of recursing.
+  struct Frame {
+    enum Kind : uint8_t {
+      Group, Lambda
+    };
+
+    Kind kind;
+    Symbol param; // Lambda: the parameter
+    Term type;    // Lambda: the type of the parameter
+    Term expr;    // The applications parsed so far, NO_TERM before the first atom
+  };
+
+  TermStore store;
+
+  std::string_view input;
   size_t pos = 0;
   std::vector<Token> tokens;
   std::stack<Gamma> gamma_stack;
+  std::vector<Frame> frames;
 
-  Node *parse_expression();
+  // Text of a token, a view into the input
+  std::string_view text(const Token &token) const { return input.substr(token.offset, token.length); }
 
-  Node *parse_atom();
+  Term parse_expression();
 
-  Node *parse_lambda();
+  Term parse_atom();
 
-  Node *parse_judgement();
+  void parse_lambda();
 
-  Node *parse_type();
+  Term parse_judgement();
 
-  Node *parse_single_type();
+  Term parse_type();
 
-  bool get_derivation(Node *root);
+  bool get_derivation(Term root);
 
-  Node *get_type(Node *root);
+  // Returns the interned text of the type of the expression at root
+  Symbol get_type(Term root);
 
   std::pair<std::string, std::string> extract_types(const std::string &str);
 };
@@ -0,0 +1,84 @@
+// printer.cc
+#include "printer.h"
+
+// Text collected before it is written to a stream
+static const size_t CHUNK_SIZE = 1 << 16;
+
+void Printer::print(const TermStore &store, Term node, std::string &out) {
+  write(store, node, out, nullptr);
+}
+
+void Printer::print(const TermStore &store, Term node, std::ostream &stream) {
+  buffer.clear();
+  write(store, node, buffer, &stream);
+  stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+}
+
+void Printer::write(const TermStore &store, Term node, std::string &out, std::ostream *stream) {
+  // Pieces still to print, the next one last
+  pending.clear();
+  pending.push_back({node, nullptr, Piece::Body});
+  while (!pending.empty()) {
+    if (stream && out.size() >= CHUNK_SIZE) {
+      stream->write(out.data(), static_cast<std::streamsize>(out.size()));
+      out.clear();
+    }
+    Piece piece = pending.back();
+    pending.pop_back();
+    if (piece.node == NO_TERM) {
+      out += piece.text;
+      continue;
+    }
+    switch (store.kind(piece.node)) {
+      case NodeKind::Variable:
+        out += symbols().name(store.symbol(piece.node));
+        break;
+      case NodeKind::Lambda: {
+        // The parser only starts an argument at a variable or a bracket, and the body would take in what follows
+        bool brackets = minimal && piece.place != Piece::Body;
+        if (brackets) {
+          out += "(";
+          pending.push_back({NO_TERM, ")", Piece::Body});
+        }
+        out += "\\";
+        out += symbols().name(store.symbol(piece.node));
+        // The type of a parameter is a type node, which holds its text
+        Term type = store.left(piece.node);
+        if (type != NO_TERM && !symbols().name(store.symbol(type)).empty()) {
+          out += "^";
+          out += symbols().name(store.symbol(type));
+        }
+        out += " ";
+        pending.push_back({store.right(piece.node), nullptr, Piece::Body});
+        break;
+      }
+      case NodeKind::Application: {
+        bool brackets = !minimal || piece.place == Piece::Argument;
+        if (brackets) {
+          out += "(";
+          pending.push_back({NO_TERM, ")", Piece::Body});
+        }
+        pending.push_back({store.right(piece.node), nullptr, Piece::Argument});
+        pending.push_back({NO_TERM, " ", Piece::Body});
+        pending.push_back({store.left(piece.node), nullptr, Piece::Function});
+        break;
+      }
+      case NodeKind::Type:
+        out += symbols().name(store.symbol(piece.node));
+        break;
+      case NodeKind::Judgement: {
+        if (minimal) {
+          pending.push_back({store.right(piece.node), nullptr, Piece::Body});
+          pending.push_back({NO_TERM, " : ", Piece::Body});
+        } else {
+          out += "(";
+          pending.push_back({NO_TERM, ")", Piece::Body});
+          pending.push_back({store.right(piece.node), nullptr, Piece::Body});
+          pending.push_back({NO_TERM, ") : (", Piece::Body});
+        }
+        pending.push_back({store.left(piece.node), nullptr, Piece::Body});
+        break;
+      }
+    }
+  }
+}
@@ -0,0 +1,46 @@
+// printer.h
+#ifndef PRINTER_H
+#define PRINTER_H
+
+#include "store.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Writes judgements and terms as text in one pass, with an explicit stack instead of recursion, so the time
+// is linear in the length of the text and no intermediate strings are built. The default format brackets
+// every application and both sides of a judgement: (\x^A (f x)) : (A -> B). The minimal format only
+// brackets what the parser needs: an application that is an argument, and a lambda that is an argument or
+// a function, since the body of a lambda extends as far as possible: \x^A f x (\y^B y) : A -> B.
+class Printer {
+public:
+  explicit Printer(bool minimal = false) : minimal(minimal) {}
+
+  // Appends the text of node of store to out
+  void print(const TermStore &store, Term node, std::string &out);
+
+  // Writes the text of node of store to stream in chunks, so a large judgement is never held as one string
+  void print(const TermStore &store, Term node, std::ostream &stream);
+
+private:
+  // Node still to print, or a literal when node is NO_TERM, and where the node is in its parent. The body of
+  // a lambda and the expression of a judgement end where their bracket or the expression ends.
+  struct Piece {
+    enum Place : uint8_t {
+      Function, Argument, Body
+    };
+
+    Term node;
+    const char *text;
+    Place place;
+  };
+
+  bool minimal;
+  // Kept between calls so their capacity is reused
+  std::vector<Piece> pending;
+  std::string buffer;
+
+  void write(const TermStore &store, Term node, std::string &out, std::ostream *stream);
+};
+
+#endif //PRINTER_H
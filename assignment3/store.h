@@ -0,0 +1,81 @@
+// store.h
+#ifndef STORE_H
+#define STORE_H
+
+#include "symbol.h"
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Tag of a node. Traversals switch on it to pick the rule for the node.
+enum class NodeKind : uint8_t {
+  Variable, Lambda, Application, Type, Judgement
+};
+
+// Id of a node in a TermStore
+typedef uint32_t Term;
+
+// Returned when there is no node, e.g. for an atom that has not been parsed yet
+const Term NO_TERM = ~Term(0);
+
+// Nodes of the judgement of one line as parallel arrays indexed by Term, instead of one heap object per node.
+// A node takes NODE_BYTES in total, its fields are contiguous with those of its neighbours, and the parser
+// adds the children of a node before the node itself. A type node holds the interned text of its type, so
+// two types are equal exactly when their symbols are. The fields of a node by kind:
+//
+//   Variable      symbol: name
+//   Lambda        symbol: parameter      left: type of the parameter   right: body
+//   Application                          left: function                right: argument
+//   Type          symbol: text
+//   Judgement                            left: expression              right: type
+class TermStore {
+public:
+  static const size_t NODE_BYTES = sizeof(NodeKind) + sizeof(Symbol) + 2 * sizeof(Term);
+
+  Term variable(Symbol name) { return add(NodeKind::Variable, name, NO_TERM, NO_TERM); }
+
+  Term lambda(Symbol param, Term type, Term body) { return add(NodeKind::Lambda, param, type, body); }
+
+  Term application(Term left, Term right) { return add(NodeKind::Application, NO_SYMBOL, left, right); }
+
+  Term type(Symbol text) { return add(NodeKind::Type, text, NO_TERM, NO_TERM); }
+
+  Term judgement(Term expr, Term type) { return add(NodeKind::Judgement, NO_SYMBOL, expr, type); }
+
+  NodeKind kind(Term term) const { return kinds[term]; }
+
+  Symbol symbol(Term term) const { return symbols[term]; }
+
+  Term left(Term term) const { return lefts[term]; }
+
+  Term right(Term term) const { return rights[term]; }
+
+  // Forgets all nodes, keeping the capacity of the arrays for the next line
+  void clear() {
+    kinds.clear();
+    symbols.clear();
+    lefts.clear();
+    rights.clear();
+  }
+
+  size_t size() const { return kinds.size(); }
+
+private:
+  std::vector<NodeKind> kinds;
+  std::vector<Symbol> symbols;
+  std::vector<Term> lefts;
+  std::vector<Term> rights;
+
+  Term add(NodeKind kind, Symbol symbol, Term left, Term right) {
+    if (kinds.size() == NO_TERM) {
+      throw std::runtime_error("Judgement too large");
+    }
+    kinds.push_back(kind);
+    symbols.push_back(symbol);
+    lefts.push_back(left);
+    rights.push_back(right);
+    return static_cast<Term>(kinds.size() - 1);
+  }
+};
+
+#endif //STORE_H
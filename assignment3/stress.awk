@@ -0,0 +1,18 @@
+# stress.awk: prints a judgement with about n nodes for the stress target of the Makefile.
+# Usage: awk -v n=1000000 -v term=nested|parens -f stress.awk
+#   nested: (\y^A (\x^A x) ((\x^A x) ( ... y))) : A -> A applications nested n deep
+#   parens: ((( ... \x^A x ... ))) : A -> A an identity inside n brackets
+BEGIN {
+  if (term == "nested") {
+    printf "(\\y^A "
+    for (i = 0; i < n; i++) printf "(\\x^A x) ("
+    printf "y"
+    for (i = 0; i < n; i++) printf ")"
+    print ") : A -> A"
+  } else if (term == "parens") {
+    for (i = 0; i < n; i++) printf "("
+    printf "\\x^A x"
+    for (i = 0; i < n; i++) printf ")"
+    print " : A -> A"
+  }
+}
@@ -0,0 +1,31 @@
+// symbol.cc
+#include "symbol.h"
+
+Symbol SymbolTable::intern(std::string_view name) {
+  auto found = ids.find(name);
+  if (found != ids.end()) {
+    return found->second;
+  }
+  Symbol symbol = static_cast<Symbol>(names.size());
+  names.emplace_back(name);
+  ids.emplace(names.back(), symbol);
+  return symbol;
+}
+
+const std::string &SymbolTable::name(Symbol symbol) const {
+  return names[symbol];
+}
+
+void SymbolTable::clear() {
+  ids.clear();
+  names.clear();
+}
+
+size_t SymbolTable::size() const {
+  return names.size();
+}
+
+SymbolTable &symbols() {
+  static thread_local SymbolTable table;
+  return table;
+}
@@ -0,0 +1,39 @@
+// symbol.h
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+typedef uint32_t Symbol;
+
+// Returned when there is no symbol, e.g. for the nodes that have no name
+const Symbol NO_SYMBOL = ~Symbol(0);
+
+// Symbol table: identifiers are interned once at parse time and afterwards handled as compact integer ids,
+// so comparing or hashing a name never touches the string again. Every thread has a table of its own, so
+// the threads of the batch mode (-j) intern without locking; a judgement must only be used on the thread
+// that parsed it.
+class SymbolTable {
+public:
+  Symbol intern(std::string_view name);
+
+  const std::string &name(Symbol symbol) const;
+
+  // Forgets all symbols, so the table does not grow with the lines before
+  void clear();
+
+  size_t size() const;
+
+private:
+  // The keys are views of the names, so a name is looked up straight from the input without a copy
+  std::unordered_map<std::string_view, Symbol> ids;
+  std::deque<std::string> names; // A deque keeps references returned by name() and the keys valid while interning
+};
+
+SymbolTable &symbols();
+
+#endif //SYMBOL_H